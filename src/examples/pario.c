@@ -0,0 +1,99 @@
+/* pario.c
+
+   Parallel file I/O benchmark.  Starts N child processes (4 by
+   default), each of which writes its own 256 kB file and then
+   reads it back twice, and waits for them all.  With the files
+   larger than the buffer cache, the children spend most of their
+   time waiting on the disk, so the elapsed time shows how well
+   the file system overlaps one process's I/O with another's.
+   Compare the "Timer: N ticks" line printed at power off, e.g.:
+
+     pintos --filesys-size=8 -p build/examples/pario -a pario \
+       -- -f -q run 'pario 4' */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define FILE_SIZE (256 * 1024)
+#define CHUNK_SIZE 4096
+#define READ_PASSES 2
+#define MAX_CHILDREN 16
+
+static char buf[CHUNK_SIZE];
+
+/* Writes and rereads file "pario-ID".  Returns an exit status. */
+static int
+child (const char *id)
+{
+  char name[16];
+  int fd, ofs, pass;
+
+  snprintf (name, sizeof name, "pario-%s", id);
+  memset (buf, id[0], sizeof buf);
+  if (!create (name, 0) || (fd = open (name)) < 0)
+    {
+      printf ("%s: create failed\n", name);
+      return EXIT_FAILURE;
+    }
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      {
+        printf ("%s: write failed\n", name);
+        return EXIT_FAILURE;
+      }
+  for (pass = 0; pass < READ_PASSES; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+        if (read (fd, buf, CHUNK_SIZE) != CHUNK_SIZE || buf[0] != id[0])
+          {
+            printf ("%s: read failed\n", name);
+            return EXIT_FAILURE;
+          }
+    }
+  close (fd);
+  remove (name);
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  pid_t children[MAX_CHILDREN];
+  int child_cnt = 4;
+  int status = EXIT_SUCCESS;
+  int i;
+
+  if (argc == 3 && !strcmp (argv[1], "-child"))
+    return child (argv[2]);
+
+  if (argc == 2)
+    child_cnt = atoi (argv[1]);
+  if (child_cnt < 1 || child_cnt > MAX_CHILDREN)
+    {
+      printf ("usage: pario [CHILDREN]\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < child_cnt; i++)
+    {
+      char cmd[32];
+
+      snprintf (cmd, sizeof cmd, "pario -child %c", 'a' + i);
+      children[i] = exec (cmd);
+      if (children[i] == PID_ERROR)
+        {
+          printf ("pario: exec failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < child_cnt; i++)
+    if (wait (children[i]) != EXIT_SUCCESS)
+      status = EXIT_FAILURE;
+
+  printf ("pario: %d children wrote and read %d kB each\n",
+          child_cnt, FILE_SIZE / 1024);
+  return status;
+}
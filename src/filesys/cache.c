@@ -1,31 +1,272 @@
 #include "threads/thread.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "filesys/cache.h"
+#include <round.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* Buffers are carved out of arenas of up to this many
+   contiguous pages. */
+#define ARENA_PAGES 8
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* How often the write-behind thread checks the dirty ratio. */
+#define FLUSH_POLL_TICKS (TIMER_FREQ / 10)
+
+/* Maximum number of sectors waiting to be read ahead. */
+#define READAHEAD_QUEUE_SIZE 32
+
+/* A run of contiguous pages holding the buffers of ENTRY_CNT
+   entries. */
+struct cache_arena
+  {
+    struct list_elem elem;              /* Element in arena list. */
+    uint8_t *buffers;                   /* Page-aligned buffers. */
+    size_t page_cnt;                    /* # of pages in BUFFERS. */
+    struct bce *entries;                /* Entries using BUFFERS. */
+  };
+
+static struct list arenas;
 static struct list buffer_cache;
-static struct lock cache_lock;
+static struct hash cache_index;         /* Valid entries, keyed by sector. */
+static struct lock cache_lock;         /* Guards the index, the entry list,
+                                           and entry bookkeeping. */
+static struct list_elem *clock_hand;    /* Next entry the clock examines. */
+
+/* Dirty entries holding file data of the inode at SECTOR, so that
+   the file can be written back by itself.  Kept in OWNER_INDEX,
+   keyed by SECTOR, only while DIRTY is nonempty.  Guarded by the
+   cache lock. */
+struct cache_owner
+  {
+    struct hash_elem hash_elem;         /* Element in owner_index. */
+    block_sector_t sector;              /* Inode sector. */
+    struct list dirty;                  /* Entries, by owner_elem. */
+  };
+
+static struct hash owner_index;
+
+static size_t cache_cnt;                /* # of entries. */
+static size_t dirty_cnt;                /* # of dirty entries. */
+static size_t journaled_cnt;            /* # of journaled entries. */
+
+/* Number of entries, set by the kernel command line.  Zero means
+   to scale the cache with the amount of RAM. */
+size_t cache_capacity;
+
+/* Replacement policy, set by the kernel command line. */
+enum cache_policy cache_policy = CACHE_CLOCK;
+
+/* Write-behind tuning, set by the kernel command line. */
+unsigned cache_flush_ms = 1000;
+unsigned cache_dirty_pct = 25;
+
+/* Read-ahead requests, a ring buffer guarded by readahead_lock. */
+static block_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head;           /* Index of oldest request. */
+static size_t readahead_len;            /* # of queued requests. */
+static struct lock readahead_lock;
+static struct condition readahead_cond; /* Signaled when a request arrives. */
+
+/* Statistics, guarded by cache_lock. */
+static struct cache_stats stats;
+
+static unsigned cache_hash_func (const struct hash_elem *e, void *aux UNUSED);
+static bool cache_less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
+static size_t cache_default_size (void);
+static size_t cache_populate (size_t cnt);
+static void cache_depopulate (void);
+static void cache_flush_locked (struct block *block);
+static struct bce *cache_select_clock (void);
+static struct bce *cache_select_lfu (void);
+static void cache_set_dirty (struct bce *bce, bool dirty);
+static bool cache_over_high_water (void);
+static void cache_write_behind (struct block *block);
+static void cache_flusher (void *block_);
+static int sector_compare (const void *a_, const void *b_);
+static struct bce *cache_lookup (block_sector_t sector);
+static struct bce *cache_evict (struct block *block);
+static void cache_write_back (struct block *block, struct bce *bce);
+static void cache_claim (struct bce *bce, block_sector_t sector, bool readahead);
+static struct bce *cache_get (struct block *block, block_sector_t sector, bool load);
+static void cache_put (struct bce *bce, bool dirty);
+static void cache_wait_unpinned (void);
+static void cache_readahead_worker (void *block_);
+static unsigned owner_hash_func (const struct hash_elem *e, void *aux UNUSED);
+static bool owner_less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
+static void cache_disown (struct bce *bce);
 
 void cache_init (void) {
   lock_init (&cache_lock);
+  list_init (&arenas);
   list_init (&buffer_cache);
-  for (int i = 0; i < 64; i++) {
-    struct bce *bce = (struct bce *) malloc (sizeof (struct bce));
-    bce->valid = false;
-    bce->dirty = false;
-    bce->acc_cnt = 0;
-    bce->sector = -1;
-    list_push_back (&buffer_cache, &bce->list_elem);
+  hash_init (&cache_index, cache_hash_func, cache_less_func, NULL);
+  hash_init (&owner_index, owner_hash_func, owner_less_func, NULL);
+  lock_init (&readahead_lock);
+  cond_init (&readahead_cond);
+  cache_populate (cache_capacity > 0 ? cache_capacity : cache_default_size ());
+}
+
+/* Returns a cache size of one sector per 16 pages of RAM, that is
+   1/128 of memory, within [CACHE_MIN_SIZE, CACHE_MAX_SIZE]. */
+static size_t cache_default_size (void) {
+  size_t cnt = init_ram_pages / 16;
+  if (cnt < CACHE_MIN_SIZE)
+    cnt = CACHE_MIN_SIZE;
+  if (cnt > CACHE_MAX_SIZE)
+    cnt = CACHE_MAX_SIZE;
+  return cnt;
+}
+
+/* Returns the number of entries in the buffer cache. */
+size_t cache_size (void) {
+  return cache_cnt;
+}
+
+static unsigned cache_hash_func (const struct hash_elem *e, void *aux UNUSED) {
+  struct bce *bce = hash_entry (e, struct bce, hash_elem);
+  return hash_int ((int) bce->sector);
+}
+
+static bool cache_less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED) {
+  struct bce *bce_a = hash_entry (a, struct bce, hash_elem);
+  struct bce *bce_b = hash_entry (b, struct bce, hash_elem);
+  return bce_a->sector < bce_b->sector;
+}
+
+/* Fills the empty buffer cache with up to CNT entries, whose
+   buffers come from page-aligned arenas of contiguous pages.
+   Stops early if memory runs out, and returns the number of
+   entries created. */
+static size_t cache_populate (size_t cnt) {
+  size_t added = 0;
+
+  ASSERT (list_empty (&buffer_cache));
+  while (added < cnt) {
+    size_t entry_cnt = cnt - added;
+    if (entry_cnt > ARENA_PAGES * SECTORS_PER_PAGE)
+      entry_cnt = ARENA_PAGES * SECTORS_PER_PAGE;
+
+    struct cache_arena *arena = malloc (sizeof *arena);
+    if (arena == NULL)
+      break;
+    arena->page_cnt = DIV_ROUND_UP (entry_cnt, SECTORS_PER_PAGE);
+    arena->buffers = palloc_get_multiple (0, arena->page_cnt);
+    arena->entries = malloc (entry_cnt * sizeof *arena->entries);
+    if (arena->buffers == NULL || arena->entries == NULL) {
+      if (arena->buffers != NULL)
+        palloc_free_multiple (arena->buffers, arena->page_cnt);
+      free (arena->entries);
+      free (arena);
+      break;
+    }
+    list_push_back (&arenas, &arena->elem);
+
+    for (size_t i = 0; i < entry_cnt; i++) {
+      struct bce *bce = &arena->entries[i];
+      bce->valid = false;
+      bce->dirty = false;
+      bce->accessed = false;
+      bce->readahead = false;
+      bce->loading = false;
+      bce->journaled = false;
+      bce->owner = NULL;
+      bce->acc_cnt = 0;
+      bce->pin_cnt = 0;
+      bce->sector = -1;
+      bce->buffer = arena->buffers + i * BLOCK_SECTOR_SIZE;
+      lock_init (&bce->lock);
+      list_push_back (&buffer_cache, &bce->list_elem);
+    }
+    added += entry_cnt;
+  }
+  if (added == 0)
+    PANIC ("buffer cache allocation failed");
+
+  cache_cnt = added;
+  clock_hand = list_begin (&buffer_cache);
+  return added;
+}
+
+/* Frees every entry of the buffer cache.  Entries must be clean
+   and unpinned. */
+static void cache_depopulate (void) {
+  struct list_elem *e;
+
+  hash_clear (&cache_index, NULL);
+  for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
+    struct bce *bce = list_entry (e, struct bce, list_elem);
+    ASSERT (!bce->dirty && bce->pin_cnt == 0);
+  }
+  list_init (&buffer_cache);
+  while (!list_empty (&arenas)) {
+    struct cache_arena *arena = list_entry (list_pop_front (&arenas), struct cache_arena, elem);
+    palloc_free_multiple (arena->buffers, arena->page_cnt);
+    free (arena->entries);
+    free (arena);
+  }
+  cache_cnt = 0;
+}
+
+/* Writes back BLOCK's dirty entries and rebuilds the buffer cache
+   with CNT empty entries, or as many as memory allows.  Returns
+   the new number of entries.  Leaves the cache as it is while any
+   entry is in a journal transaction, which must not reach its home
+   sector before the transaction commits, and returns the current
+   number of entries. */
+size_t cache_resize (struct block *block, size_t cnt) {
+  ASSERT (cnt > 0);
+  lock_acquire (&cache_lock);
+  cache_wait_unpinned ();
+  if (journaled_cnt > 0) {
+    cnt = cache_cnt;
+    lock_release (&cache_lock);
+    return cnt;
   }
+  cache_flush_locked (block);
+  cache_depopulate ();
+  cnt = cache_populate (cnt);
+  lock_release (&cache_lock);
+  return cnt;
 }
 
-struct bce * cache_allocate (struct block *block) {
+/* Picks the entry under the clock hand that has not been
+   referenced since the hand last passed it, clearing reference
+   bits along the way.  Pinned and journaled entries are passed
+   over.  Returns a null pointer if two sweeps find nothing else. */
+static struct bce *cache_select_clock (void) {
+  for (size_t i = 0; i < 2 * cache_cnt; i++) {
+    struct bce *bce = list_entry (clock_hand, struct bce, list_elem);
+    clock_hand = list_next (clock_hand);
+    if (clock_hand == list_end (&buffer_cache))
+      clock_hand = list_begin (&buffer_cache);
+
+    if (bce->pin_cnt > 0 || bce->journaled)
+      continue;
+    if (!bce->valid || !bce->accessed)
+      return bce;
+    bce->accessed = false;
+  }
+  return NULL;
+}
+
+/* Picks an unpinned invalid entry, or else the unpinned entry
+   with the fewest accesses since it was loaded, passing over
+   journaled entries.  Returns a null pointer if there is none. */
+static struct bce *cache_select_lfu (void) {
   struct bce *evict_target = NULL;
   int acc_cnt = -1;
   struct list_elem *e;
 
   for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
     struct bce *bce = list_entry (e, struct bce, list_elem);
+    if (bce->pin_cnt > 0 || bce->journaled)
+      continue;
     if (bce->valid == false) {
       return bce;
     }
@@ -34,67 +275,561 @@ struct bce * cache_allocate (struct block *block) {
       acc_cnt = bce->acc_cnt;
     }
   }
+  return evict_target;
+}
+
+/* Picks a victim, removes it from the index, and returns it
+   clean and unpinned.  The caller must hold the cache lock.
+
+   If the victim is dirty, or every entry is pinned, the lock is
+   dropped to write it back or to let other threads run, and a
+   null pointer is returned: the caller must then look its sector
+   up again, since another thread may have loaded it meanwhile. */
+static struct bce *cache_evict (struct block *block) {
+  struct bce *evict_target;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  if (cache_policy == CACHE_LFU)
+    evict_target = cache_select_lfu ();
+  else
+    evict_target = cache_select_clock ();
+
+  if (evict_target == NULL) {
+    lock_release (&cache_lock);
+    thread_yield ();
+    lock_acquire (&cache_lock);
+    return NULL;
+  }
 
-  ASSERT (evict_target != NULL);
-  ASSERT (evict_target->acc_cnt != -1);
-  ASSERT (evict_target->valid == 1);
+  if (!evict_target->valid)
+    return evict_target;
 
-  if (evict_target->dirty) 
-    block_write (block, evict_target->sector, evict_target->buffer);
+  if (evict_target->dirty) {
+    cache_write_back (block, evict_target);
+    return NULL;
+  }
+  stats.evictions++;
+  if (evict_target->readahead)
+    stats.readahead_wasted++;
+  hash_delete (&cache_index, &evict_target->hash_elem);
+  evict_target->valid = false;
 
   return evict_target;
 }
 
+/* Writes dirty entry BCE back to BLOCK.  The caller must hold the
+   cache lock, which is released during the write.  BCE is marked
+   clean before the write, so a concurrent cache_write marks it
+   dirty again rather than having its update forgotten.  If BCE
+   joined a journal transaction meanwhile, it is not written: its
+   buffer may hold uncommitted changes, and the write that put it
+   in the transaction has marked it dirty again. */
+static void cache_write_back (struct block *block, struct bce *bce) {
+  bool written = false;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (bce->valid && bce->dirty);
+
+  cache_set_dirty (bce, false);
+  bce->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&bce->lock);
+  if (!bce->journaled) {
+    block_write (block, bce->sector, bce->buffer);
+    written = true;
+  }
+  lock_release (&bce->lock);
+
+  lock_acquire (&cache_lock);
+  bce->pin_cnt--;
+  if (written)
+    stats.writebacks++;
+}
+
+/* Makes BCE, a clean entry returned by cache_evict(), cache
+   SECTOR, and leaves it pinned and locked in the loading state.
+   READAHEAD marks an entry loaded ahead of any request for it.
+   Releases the cache lock, which the caller must hold. */
+static void cache_claim (struct bce *bce, block_sector_t sector, bool readahead) {
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (!bce->valid && bce->pin_cnt == 0);
+
+  bce->valid = true;
+  bce->accessed = !readahead;
+  bce->readahead = readahead;
+  bce->acc_cnt = 0;
+  bce->sector = sector;
+  bce->pin_cnt = 1;
+  hash_insert (&cache_index, &bce->hash_elem);
+
+  /* Nobody else can hold the lock of an unpinned entry. */
+  lock_acquire (&bce->lock);
+  bce->loading = true;
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry for SECTOR in BLOCK, pinned and with its lock
+   held.  On a miss the sector is read from BLOCK if LOAD is true;
+   otherwise the buffer is left as is for a caller that is about
+   to overwrite all of it.  The cache lock is held
+   only while the index is consulted, never across disk I/O; a
+   thread that finds SECTOR still being loaded by another waits on
+   the entry lock instead of reading it a second time. */
+static struct bce *cache_get (struct block *block, block_sector_t sector, bool load) {
+  struct bce *bce;
+
+  lock_acquire (&cache_lock);
+  for (;;) {
+    bce = cache_lookup (sector);
+    if (bce != NULL) {
+      stats.hits++;
+      if (bce->readahead) {
+        stats.readahead_used++;
+        bce->readahead = false;
+      }
+      bce->accessed = true;
+      bce->acc_cnt++;
+      bce->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&bce->lock);
+      ASSERT (!bce->loading);
+      return bce;
+    }
+
+    bce = cache_evict (block);
+    if (bce != NULL)
+      break;
+  }
+  stats.misses++;
+  if (!load)
+    stats.read_skips++;
+  cache_claim (bce, sector, false);
+
+  if (load)
+    block_read (block, sector, bce->buffer);
+  bce->loading = false;
+  return bce;
+}
+
+/* Releases BCE, obtained from cache_get(), marking it dirty if
+   DIRTY is true. */
+static void cache_put (struct bce *bce, bool dirty) {
+  lock_release (&bce->lock);
+
+  lock_acquire (&cache_lock);
+  if (dirty)
+    cache_set_dirty (bce, true);
+  bce->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
 void
 cache_read (struct block *block, block_sector_t sector, void *buffer, int size, int offset)
 {
-  lock_acquire (&cache_lock);
-
-  struct bce *target = cache_find (block, sector);
+  struct bce *target = cache_get (block, sector, true);
   memcpy (buffer, target->buffer + offset, size);
-  target->acc_cnt += 1;
+  cache_put (target, false);
+}
 
-  lock_release (&cache_lock);
+/* Returns the IDX'th sector number stored in SECTOR, an array of
+   block_sector_t such as an indirect block, without copying out
+   the rest of the sector. */
+block_sector_t
+cache_read_index (struct block *block, block_sector_t sector, size_t idx)
+{
+  ASSERT (idx < BLOCK_SECTOR_SIZE / sizeof (block_sector_t));
+
+  struct bce *target = cache_get (block, sector, true);
+  block_sector_t result = ((block_sector_t *) target->buffer)[idx];
+  cache_put (target, false);
+  return result;
 }
 
+/* Writes SIZE bytes from BUFFER into SECTOR at OFFSET.  A write
+   covering the whole sector does not read the old contents. */
 void
 cache_write (struct block *block, block_sector_t sector, void *buffer, int size, int offset)
-{ 
+{
+  bool whole = offset == 0 && size == BLOCK_SECTOR_SIZE;
+  struct bce *target = cache_get (block, sector, !whole);
+  memcpy (target->buffer + offset, buffer, size);
+  cache_put (target, true);
+}
+
+/* Like cache_write(), but also adds SECTOR to the running journal
+   transaction, which keeps it in the cache, unwritten, until
+   cache_unjournal().  Returns true if SECTOR was not already in
+   the transaction. */
+bool
+cache_write_journaled (struct block *block, block_sector_t sector, void *buffer, int size, int offset)
+{
+  bool whole = offset == 0 && size == BLOCK_SECTOR_SIZE;
+  struct bce *target = cache_get (block, sector, !whole);
+  bool added;
+
+  memcpy (target->buffer + offset, buffer, size);
+  lock_acquire (&cache_lock);
+  added = !target->journaled;
+  if (added)
+    journaled_cnt++;
+  target->journaled = true;
+  lock_release (&cache_lock);
+  cache_put (target, true);
+  return added;
+}
+
+/* Returns true if SECTOR is in the running journal transaction. */
+bool cache_journaled (block_sector_t sector) {
+  bool journaled;
+
+  lock_acquire (&cache_lock);
+  struct bce *bce = cache_lookup (sector);
+  journaled = bce != NULL && bce->journaled;
+  lock_release (&cache_lock);
+  return journaled;
+}
+
+/* Takes SECTOR out of the journal transaction it was added to,
+   once that has committed, so that it can be written back and
+   evicted like any other entry. */
+void cache_unjournal (block_sector_t sector) {
   lock_acquire (&cache_lock);
+  struct bce *bce = cache_lookup (sector);
+  if (bce != NULL && bce->journaled) {
+    bce->journaled = false;
+    journaled_cnt--;
+  }
+  lock_release (&cache_lock);
+}
+
+/* Writes SECTOR back to BLOCK now if it is cached dirty and not
+   journaled. */
+void cache_write_sector (struct block *block, block_sector_t sector) {
+  lock_acquire (&cache_lock);
+  struct bce *bce = cache_lookup (sector);
+  if (bce != NULL && bce->dirty && !bce->journaled)
+    cache_write_back (block, bce);
+  lock_release (&cache_lock);
+}
+
+static unsigned owner_hash_func (const struct hash_elem *e, void *aux UNUSED) {
+  struct cache_owner *owner = hash_entry (e, struct cache_owner, hash_elem);
+  return hash_int (owner->sector);
+}
+
+static bool owner_less_func (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED) {
+  struct cache_owner *owner_a = hash_entry (a, struct cache_owner, hash_elem);
+  struct cache_owner *owner_b = hash_entry (b, struct cache_owner, hash_elem);
+  return owner_a->sector < owner_b->sector;
+}
+
+/* Returns the owner record for the inode at SECTOR, creating it if
+   CREATE is true.  Returns a null pointer if there is none or
+   memory is short.  The caller must hold the cache lock. */
+static struct cache_owner *cache_owner_find (block_sector_t sector, bool create) {
+  struct cache_owner sample;
+  sample.sector = sector;
+  struct hash_elem *e = hash_find (&owner_index, &sample.hash_elem);
+  if (e != NULL)
+    return hash_entry (e, struct cache_owner, hash_elem);
+  if (!create)
+    return NULL;
+
+  struct cache_owner *owner = malloc (sizeof *owner);
+  if (owner == NULL)
+    return NULL;
+  owner->sector = sector;
+  list_init (&owner->dirty);
+  hash_insert (&owner_index, &owner->hash_elem);
+  return owner;
+}
+
+/* Takes BCE off its owner's dirty list, if it is on one.  The
+   caller must hold the cache lock. */
+static void cache_disown (struct bce *bce) {
+  struct cache_owner *owner = bce->owner;
+
+  if (owner == NULL)
+    return;
+  list_remove (&bce->owner_elem);
+  bce->owner = NULL;
+  if (list_empty (&owner->dirty)) {
+    hash_delete (&owner_index, &owner->hash_elem);
+    free (owner);
+  }
+}
+
+/* Like cache_write(), but records SECTOR as file data of the inode
+   at sector OWNER, for cache_flush_owner(). */
+void
+cache_write_owned (struct block *block, block_sector_t sector, void *buffer, int size, int offset, block_sector_t owner)
+{
+  bool whole = offset == 0 && size == BLOCK_SECTOR_SIZE;
+  struct bce *target = cache_get (block, sector, !whole);
+  struct cache_owner *co;
 
-  struct bce *target = cache_find (block, sector);
   memcpy (target->buffer + offset, buffer, size);
-  target->dirty = true;
+  lock_release (&target->lock);
 
+  lock_acquire (&cache_lock);
+  cache_set_dirty (target, true);
+  if (target->owner == NULL || target->owner->sector != owner) {
+    cache_disown (target);
+    co = cache_owner_find (owner, true);
+    if (co != NULL) {
+      list_push_back (&co->dirty, &target->owner_elem);
+      target->owner = co;
+    }
+  }
+  target->pin_cnt--;
   lock_release (&cache_lock);
 }
 
-struct bce *cache_find (struct block *block, block_sector_t sector) {
+/* Writes the dirty data of the inode at sector OWNER back to BLOCK
+   in ascending sector order.  The cache lock is not held during
+   the writes. */
+void cache_flush_owner (struct block *block, block_sector_t owner) {
+  block_sector_t *sectors = NULL;
+  size_t cnt = 0;
+  struct cache_owner *co;
   struct list_elem *e;
-  struct bce *bce = NULL;
-  for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
-    bce = list_entry (e, struct bce, list_elem);
-    if (bce->sector == sector) {
-      return bce;
-    }
+
+  lock_acquire (&cache_lock);
+  co = cache_owner_find (owner, false);
+  if (co != NULL)
+    sectors = malloc (list_size (&co->dirty) * sizeof *sectors);
+  if (sectors == NULL) {
+    lock_release (&cache_lock);
+    if (co != NULL)
+      cache_flush (block);
+    return;
   }
-  bce = cache_allocate (block);
-  block_read (block, sector, bce->buffer);
-  bce->valid = true;
-  bce->dirty = false;
-  bce->acc_cnt = 0;
-  bce->sector = sector;
-  return bce;
+  for (e = list_begin (&co->dirty); e != list_end (&co->dirty); e = list_next (e))
+    sectors[cnt++] = list_entry (e, struct bce, owner_elem)->sector;
+  lock_release (&cache_lock);
+
+  qsort (sectors, cnt, sizeof *sectors, sector_compare);
+  lock_acquire (&cache_lock);
+  for (size_t i = 0; i < cnt; i++) {
+    struct bce *bce = cache_lookup (sectors[i]);
+    if (bce != NULL && bce->dirty && !bce->journaled)
+      cache_write_back (block, bce);
+  }
+  lock_release (&cache_lock);
+  free (sectors);
+}
+
+/* Returns the valid entry caching SECTOR, or a null pointer if
+   SECTOR is not cached.  The caller must hold the cache lock. */
+static struct bce *cache_lookup (block_sector_t sector) {
+  struct bce sample;
+  sample.sector = sector;
+  struct hash_elem *e = hash_find (&cache_index, &sample.hash_elem);
+  if (e == NULL) return NULL;
+  return hash_entry (e, struct bce, hash_elem);
 }
 
 void cache_flush (struct block *block) {
+  cache_write_behind (block);
+}
+
+/* Waits until no entry is pinned.  The caller must hold the cache
+   lock, and keeps it on return, so no new pins can appear. */
+static void cache_wait_unpinned (void) {
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); ) {
+    struct bce *bce = list_entry (e, struct bce, list_elem);
+    if (bce->pin_cnt > 0) {
+      lock_release (&cache_lock);
+      thread_yield ();
+      lock_acquire (&cache_lock);
+      e = list_begin (&buffer_cache);
+    }
+    else
+      e = list_next (e);
+  }
+}
+
+/* Writes back every dirty entry.  The caller must hold the cache
+   lock, and no entry may be pinned. */
+static void cache_flush_locked (struct block *block) {
   struct list_elem *e;
   struct bce *bce = NULL;
   for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
     bce = list_entry (e, struct bce, list_elem);
+    ASSERT (bce->pin_cnt == 0);
     if (bce->dirty) {
       block_write (block, bce->sector, bce->buffer);
-      bce->dirty = false;
+      cache_set_dirty (bce, false);
+      stats.writebacks++;
     }
   }
-}
\ No newline at end of file
+}
+
+/* Marks BCE dirty or clean, keeping the dirty count in step.  A
+   clean entry leaves its owner's dirty list. */
+static void cache_set_dirty (struct bce *bce, bool dirty) {
+  if (bce->dirty != dirty)
+    dirty_cnt += dirty ? 1 : -1;
+  bce->dirty = dirty;
+  if (!dirty)
+    cache_disown (bce);
+}
+
+/* Returns true if more than cache_dirty_pct percent of the
+   entries are dirty and may be written back.  Journaled entries,
+   which are dirty until their transaction commits, do not count,
+   or the write-behind thread would spin until the next commit. */
+static bool cache_over_high_water (void) {
+  size_t writable = dirty_cnt > journaled_cnt ? dirty_cnt - journaled_cnt : 0;
+  return writable * 100 > cache_cnt * cache_dirty_pct;
+}
+
+static int sector_compare (const void *a_, const void *b_) {
+  const block_sector_t *a = a_;
+  const block_sector_t *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Writes every dirty entry that is not journaled back to BLOCK in
+   ascending sector order, or in list order if there is no memory
+   to sort them.  The cache lock is not held during the writes. */
+static void cache_write_behind (struct block *block) {
+  block_sector_t *sectors;
+  size_t cnt = 0;
+  struct list_elem *e;
+
+  lock_acquire (&cache_lock);
+  sectors = malloc (dirty_cnt * sizeof *sectors);
+  if (sectors == NULL) {
+    /* Each entry stays pinned while it is written, so the list
+       cannot change under the walk. */
+    for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
+      struct bce *bce = list_entry (e, struct bce, list_elem);
+      if (bce->dirty && !bce->journaled)
+        cache_write_back (block, bce);
+    }
+    lock_release (&cache_lock);
+    return;
+  }
+  for (e = list_begin (&buffer_cache); e != list_end (&buffer_cache); e = list_next (e)) {
+    struct bce *bce = list_entry (e, struct bce, list_elem);
+    if (bce->dirty && !bce->journaled)
+      sectors[cnt++] = bce->sector;
+  }
+  lock_release (&cache_lock);
+
+  qsort (sectors, cnt, sizeof *sectors, sector_compare);
+  lock_acquire (&cache_lock);
+  for (size_t i = 0; i < cnt; i++) {
+    struct bce *bce = cache_lookup (sectors[i]);
+    if (bce != NULL && bce->dirty && !bce->journaled)
+      cache_write_back (block, bce);
+  }
+  lock_release (&cache_lock);
+  free (sectors);
+}
+
+/* Write-behind thread.  Flushes BLOCK's dirty entries every
+   cache_flush_ms milliseconds, or sooner once the dirty ratio
+   passes cache_dirty_pct, so that eviction seldom has to write
+   back its victim. */
+static void cache_flusher (void *block_) {
+  struct block *block = block_;
+  int64_t interval = (int64_t) cache_flush_ms * TIMER_FREQ / 1000;
+
+  if (interval < 1)
+    interval = 1;
+  for (;;) {
+    int64_t deadline = timer_ticks () + interval;
+    while (timer_ticks () < deadline && !cache_over_high_water ())
+      timer_sleep (FLUSH_POLL_TICKS < interval ? FLUSH_POLL_TICKS : interval);
+    cache_write_behind (block);
+  }
+}
+
+/* Starts the write-behind thread for BLOCK, unless it was
+   disabled with a zero flush interval. */
+void cache_flusher_start (struct block *block) {
+  if (cache_flush_ms > 0)
+    thread_create ("cache_flusher", PRI_DEFAULT, cache_flusher, block);
+}
+
+/* Copies the buffer cache statistics into *S. */
+void cache_get_stats (struct cache_stats *s) {
+  lock_acquire (&cache_lock);
+  *s = stats;
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void cache_print_stats (void) {
+  unsigned long long lookups = stats.hits + stats.misses;
+  printf ("Cache: %zu entries, %s policy\n",
+          cache_cnt, cache_policy == CACHE_LFU ? "lfu" : "clock");
+  printf ("Cache: %llu hits, %llu misses (%llu%% hit rate), "
+          "%llu misses not read\n",
+          stats.hits, stats.misses,
+          lookups > 0 ? stats.hits * 100 / lookups : 0, stats.read_skips);
+  printf ("Cache: %llu evictions, %llu writebacks\n",
+          stats.evictions, stats.writebacks);
+  printf ("Cache: %llu sectors read ahead, %llu used, %llu wasted\n",
+          stats.readaheads, stats.readahead_used, stats.readahead_wasted);
+}
+
+/* Queues SECTOR to be read into the cache in the background.
+   Never blocks on I/O: if the queue is full the request is
+   dropped. */
+void cache_readahead (block_sector_t sector) {
+  lock_acquire (&readahead_lock);
+  if (readahead_len < READAHEAD_QUEUE_SIZE) {
+    readahead_queue[(readahead_head + readahead_len) % READAHEAD_QUEUE_SIZE] = sector;
+    readahead_len++;
+    cond_signal (&readahead_cond, &readahead_lock);
+  }
+  lock_release (&readahead_lock);
+}
+
+/* Read-ahead thread.  Loads queued sectors of BLOCK that are not
+   already cached, marking them so that their first use, or their
+   eviction without one, is counted. */
+static void cache_readahead_worker (void *block_) {
+  struct block *block = block_;
+
+  for (;;) {
+    block_sector_t sector;
+    struct bce *bce = NULL;
+
+    lock_acquire (&readahead_lock);
+    while (readahead_len == 0)
+      cond_wait (&readahead_cond, &readahead_lock);
+    sector = readahead_queue[readahead_head];
+    readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+    readahead_len--;
+    lock_release (&readahead_lock);
+
+    lock_acquire (&cache_lock);
+    while (bce == NULL && cache_lookup (sector) == NULL)
+      bce = cache_evict (block);
+    if (bce == NULL) {
+      lock_release (&cache_lock);
+      continue;
+    }
+
+    stats.readaheads++;
+    cache_claim (bce, sector, true);
+    block_read (block, sector, bce->buffer);
+    bce->loading = false;
+    cache_put (bce, false);
+  }
+}
+
+/* Starts the read-ahead thread for BLOCK. */
+void cache_readahead_start (struct block *block) {
+  thread_create ("cache_readahead", PRI_DEFAULT, cache_readahead_worker, block);
+}
@@ -1,25 +1,69 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
+#include <cache-stats.h>
 #include <debug.h>
+#include <hash.h>
 #include "threads/synch.h"
 #include "devices/block.h"
 
+/* Bounds on the default number of buffer cache entries. */
+#define CACHE_MIN_SIZE 64
+#define CACHE_MAX_SIZE 4096
+
+/* Buffer cache replacement policies. */
+enum cache_policy
+  {
+    CACHE_CLOCK,                        /* Second-chance clock (default). */
+    CACHE_LFU                           /* Fewest accesses since load. */
+  };
+
+extern size_t cache_capacity;
+extern enum cache_policy cache_policy;
+extern unsigned cache_flush_ms;
+extern unsigned cache_dirty_pct;
+
+/* Buffer cache entry.  The cache lock guards every member except
+   BUFFER and LOADING, which belong to the holder of LOCK.  An entry
+   with a nonzero PIN_CNT is in use and is never evicted.  A
+   JOURNALED entry is neither evicted nor written back until its
+   transaction commits; it only becomes JOURNALED while LOCK is
+   held as well. */
 struct bce {
   bool valid;
   bool dirty;
+  bool accessed;                        /* Reference bit for the clock. */
+  bool readahead;                       /* Read ahead and not yet used? */
+  bool loading;                         /* Being read from disk? */
+  bool journaled;                       /* In the running journal transaction? */
   int acc_cnt;
+  int pin_cnt;                          /* # of threads using the entry. */
   block_sector_t sector;
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  struct lock lock;                     /* Guards BUFFER. */
+  uint8_t *buffer;                      /* BLOCK_SECTOR_SIZE bytes in an arena. */
   struct list_elem list_elem;
+  struct hash_elem hash_elem;           /* Element in sector index. */
+  struct cache_owner *owner;            /* Inode whose dirty data this is. */
+  struct list_elem owner_elem;          /* Element in OWNER's dirty list. */
 };
 
 void cache_init (void);
+size_t cache_size (void);
+size_t cache_resize (struct block *block, size_t cnt);
+void cache_flusher_start (struct block *block);
+void cache_readahead_start (struct block *block);
+void cache_readahead (block_sector_t sector);
 void cache_clear (struct bce *bce);
 void cache_flush (struct block *block);
 void cache_read (struct block *block, block_sector_t sector, void *buffer, int size, int offset);
+block_sector_t cache_read_index (struct block *block, block_sector_t sector, size_t idx);
 void cache_write (struct block *block, block_sector_t sector, void *buffer, int size, int offset);
-
-struct bce *cache_allocate (struct block *block);
-struct bce *cache_find (struct block *block, block_sector_t sector);
+bool cache_write_journaled (struct block *block, block_sector_t sector, void *buffer, int size, int offset);
+bool cache_journaled (block_sector_t sector);
+void cache_unjournal (block_sector_t sector);
+void cache_write_sector (struct block *block, block_sector_t sector);
+void cache_write_owned (struct block *block, block_sector_t sector, void *buffer, int size, int offset, block_sector_t owner);
+void cache_flush_owner (struct block *block, block_sector_t owner);
+void cache_get_stats (struct cache_stats *);
+void cache_print_stats (void);
 
 #endif
@@ -0,0 +1,177 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of cached directory entries. */
+#define DCACHE_MAX 256
+
+/* A cached result of looking up NAME in the directory whose inode
+   is at sector DIR.  A positive entry records the sector of the
+   inode NAME refers to; a negative one records that DIR has no
+   entry named NAME. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentry_table. */
+    struct list_elem lru_elem;          /* Element in dentry_lru. */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[NAME_MAX + 1];            /* Entry name. */
+    bool found;                         /* Positive entry? */
+    block_sector_t sector;              /* Inode sector, if FOUND. */
+  };
+
+/* Cached entries keyed by (DIR, NAME), and the same entries in
+   least- to most-recently used order.  Entries are only inserted
+   or changed while DIR's directory lock is held, the same lock
+   that guards the directory's contents, so a cached entry never
+   disagrees with the directory.  DCACHE_LOCK guards the table
+   and the list. */
+static struct hash dentry_table;
+static struct list dentry_lru;
+static size_t dentry_cnt;
+static struct lock dcache_lock;
+
+static unsigned
+dentry_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less_func (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentry_table, dentry_hash_func, dentry_less_func, NULL);
+  list_init (&dentry_lru);
+  lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer if
+   there is none.  The caller must hold dcache_lock. */
+static struct dentry *
+dentry_find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.  The caller must hold
+   dcache_lock. */
+static void
+dentry_free (struct dentry *d)
+{
+  hash_delete (&dentry_table, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  dentry_cnt--;
+  free (d);
+}
+
+/* Looks up NAME in the directory whose inode is at sector DIR.
+   Returns DCACHE_FOUND and sets *SECTOR to the sector of NAME's
+   inode if it is cached as present, DCACHE_ABSENT if it is cached
+   as not present, and DCACHE_MISS otherwise. */
+enum dcache_result
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  enum dcache_result result = DCACHE_MISS;
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = dentry_find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_back (&dentry_lru, &d->lru_elem);
+      if (d->found)
+        {
+          *sector = d->sector;
+          result = DCACHE_FOUND;
+        }
+      else
+        result = DCACHE_ABSENT;
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records that NAME in the directory whose inode is at sector DIR
+   refers to the inode at SECTOR if FOUND is true, or that DIR has
+   no entry named NAME if FOUND is false, replacing anything cached
+   for NAME before.  The caller must hold DIR's directory lock. */
+void
+dcache_insert (block_sector_t dir, const char *name, bool found,
+               block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = dentry_find (dir, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        {
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentry_table, &d->hash_elem);
+      dentry_cnt++;
+    }
+  d->found = found;
+  d->sector = found ? sector : 0;
+  list_push_back (&dentry_lru, &d->lru_elem);
+
+  if (dentry_cnt > DCACHE_MAX)
+    dentry_free (list_entry (list_front (&dentry_lru), struct dentry,
+                             lru_elem));
+  lock_release (&dcache_lock);
+}
+
+/* Drops every entry cached for the directory whose inode is at
+   sector DIR, which is being removed, so that nothing cached for
+   it is seen if its sector is reused. */
+void
+dcache_purge (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&dentry_lru); e != list_end (&dentry_lru); e = next)
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      next = list_next (e);
+      if (d->dir == dir)
+        dentry_free (d);
+    }
+  lock_release (&dcache_lock);
+}
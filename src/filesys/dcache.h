@@ -0,0 +1,22 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Result of a directory entry cache lookup. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Nothing cached; search the directory. */
+    DCACHE_FOUND,               /* Name is present. */
+    DCACHE_ABSENT               /* Name is known not to be present. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (block_sector_t dir, const char *name,
+                                  block_sector_t *sector);
+void dcache_insert (block_sector_t dir, const char *name, bool found,
+                    block_sector_t sector);
+void dcache_purge (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -1,9 +1,13 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -22,12 +26,116 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory header, stored in place of the first entry.
+
+   A directory starts out as a linear array of entries that is
+   searched front to back.  Once adding an entry would take it
+   past DIR_HASH_THRESHOLD entries, it is converted to a hashed
+   directory: the first sector holds only the header, and each
+   following sector is a bucket of BUCKET_ENTRIES entries whose
+   names hash to the bucket's index modulo BUCKET_CNT.  When a
+   bucket fills up, the number of buckets doubles. */
+struct dir_header
+  {
+    block_sector_t parent_sector;       /* Parent directory's inode. */
+    unsigned magic;                     /* DIR_HASH_MAGIC if hashed. */
+    uint32_t bucket_cnt;                /* Number of buckets if hashed. */
+    char unused[NAME_MAX - 3];
+    bool in_use;                        /* Always true. */
+  };
+
+/* Identifies a hashed directory. */
+#define DIR_HASH_MAGIC 0x48534944
+
+/* Number of entries a linear directory may hold. */
+#define DIR_HASH_THRESHOLD 64
+
+/* Initial and maximum number of buckets of a hashed directory. */
+#define DIR_MIN_BUCKETS 8
+#define DIR_MAX_BUCKETS 1024
+
+/* Free slot offset that lookup() reports when it could not
+   search the directory. */
+#define SLOT_ERROR ((off_t) -2)
+
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* A bucket of a hashed directory, one sector long. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - BUCKET_ENTRIES * sizeof (struct dir_entry)];
+  };
+
+/* Reads the header of directory INODE into *H. */
+static void
+read_header (struct inode *inode, struct dir_header *h)
+{
+  if (inode_read_at (inode, h, sizeof *h, 0) != sizeof *h)
+    memset (h, 0, sizeof *h);
+}
+
+/* Writes a header for a linear directory whose parent is in
+   sector PARENT to directory INODE. */
+static void
+write_header (struct inode *inode, block_sector_t parent)
+{
+  struct dir_header h;
+
+  memset (&h, 0, sizeof h);
+  h.parent_sector = parent;
+  h.in_use = true;
+  inode_write_at (inode, &h, sizeof h, 0);
+}
+
+/* Returns true if H is the header of a hashed directory. */
+static inline bool
+is_hashed (const struct dir_header *h)
+{
+  return h->magic == DIR_HASH_MAGIC;
+}
+
+/* Returns the byte offset of BUCKET in a hashed directory. */
+static inline off_t
+bucket_ofs (unsigned bucket)
+{
+  return (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that NAME belongs in among BUCKET_CNT. */
+static inline unsigned
+name_bucket (const char *name, unsigned bucket_cnt)
+{
+  return hash_string (name) % bucket_cnt;
+}
+
+/* Returns the offset of the first entry slot at or after POS in
+   a directory whose header is H, skipping the header and, in a
+   hashed directory, the unused tail of each sector. */
+static off_t
+next_slot (const struct dir_header *h, off_t pos)
+{
+  if (pos < (off_t) sizeof (struct dir_entry))
+    pos = sizeof (struct dir_entry);
+  if (is_hashed (h))
+    {
+      if (pos < BLOCK_SECTOR_SIZE)
+        pos = BLOCK_SECTOR_SIZE;
+      if (pos % BLOCK_SECTOR_SIZE
+          > (off_t) ((BUCKET_ENTRIES - 1) * sizeof (struct dir_entry)))
+        pos = ROUND_UP (pos, BLOCK_SECTOR_SIZE);
+    }
+  return pos;
+}
+
 struct dir *
 dir_get_parent (struct dir *dir_ptr)
 {
-  struct dir_entry e;
-  inode_read_at (dir_ptr->inode, &e, sizeof e, 0);
-  return dir_open (inode_open (e.parent_sector));
+  struct dir_header h;
+  read_header (dir_ptr->inode, &h);
+  return dir_open (inode_open (h.parent_sector));
 }
 
 /* Creates a directory with space for ENTRY_CNT entries in the
@@ -38,10 +146,8 @@ dir_create (block_sector_t sector, size_t entry_cnt)
   bool success = inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
   if (success) {
     struct inode *inode = inode_open (sector);
-    struct dir_entry f;
-    f.in_use = true;
-    f.parent_sector = inode_get_inumber (inode);
-    inode_write_at (inode, &f, sizeof f, 0);
+    write_header (inode, inode_get_inumber (inode));
+    inode_close (inode);
   }
   return success;
 }
@@ -100,32 +206,95 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Reads up to BUCKET_ENTRIES consecutive entry slots of directory
+   INODE, whose header is H, into BUF, starting at the first slot
+   at or after *OFSP, and sets *OFSP to that slot's offset.  The
+   slots read never cross a bucket boundary.  Returns the number
+   of slots read, which is 0 at the end of the directory. */
+static size_t
+read_slots (struct inode *inode, const struct dir_header *h, off_t *ofsp,
+            struct dir_bucket *buf)
+{
+  off_t ofs = next_slot (h, *ofsp);
+  size_t cnt = BUCKET_ENTRIES;
+
+  if (is_hashed (h))
+    cnt -= (ofs % BLOCK_SECTOR_SIZE) / sizeof (struct dir_entry);
+  *ofsp = ofs;
+  return (inode_read_at (inode, buf->entries, cnt * sizeof (struct dir_entry),
+                         ofs)
+          / sizeof (struct dir_entry));
+}
+
+/* Searches DIR, whose header is *H, for a file with the given
+   NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.  If FREEP is
+   non-null, it then sets *FREEP to the offset of the first free
+   slot that NAME could be added in: in a linear directory the
+   first unused slot, or end of file; in a hashed directory an
+   unused slot of NAME's bucket, or -1 if the bucket is full.
+   If memory runs out before the search, it returns false and
+   sets *FREEP to SLOT_ERROR.  Entries are read a bucket-sized
+   batch at a time, and a hashed directory is searched by
+   reading only the bucket NAME hashes to.  The outcome is
+   entered in the directory entry cache. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const struct dir_header *h, const char *name,
+        struct dir_entry *ep, off_t *ofsp, off_t *freep) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_bucket *buf;
+  off_t free_ofs = -1;
+  bool found = false;
+  off_t ofs;
+  size_t cnt, i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  buf = malloc (sizeof *buf);
+  if (buf == NULL)
+    {
+      if (freep != NULL)
+        *freep = SLOT_ERROR;
+      return false;
+    }
+
+  ofs = is_hashed (h) ? bucket_ofs (name_bucket (name, h->bucket_cnt)) : 0;
+  while (!found && (cnt = read_slots (dir->inode, h, &ofs, buf)) > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        {
+          struct dir_entry *e = &buf->entries[i];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              dcache_insert (inode_get_inumber (dir->inode), name, true,
+                             e->inode_sector);
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = ofs + i * sizeof *e;
+              found = true;
+              break;
+            }
+          if (!e->in_use && free_ofs == -1)
+            free_ofs = ofs + i * sizeof *e;
+        }
+      ofs += cnt * sizeof (struct dir_entry);
+      if (is_hashed (h))
+        break;
+    }
+  free (buf);
+
+  /* The scan was complete, so its outcome can be cached. */
+  if (!found)
+    dcache_insert (inode_get_inumber (dir->inode), name, false, 0);
+
+  if (!found && freep != NULL)
+    *freep = free_ofs != -1 || is_hashed (h) ? free_ofs : ofs;
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -136,19 +305,218 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  struct dir_header h;
   struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  inode_lock_dir (dir->inode);
+  switch (dcache_lookup (inode_get_inumber (dir->inode), name, &sector))
+    {
+    case DCACHE_FOUND:
+      *inode = inode_open (sector);
+      break;
+    case DCACHE_ABSENT:
+      *inode = NULL;
+      break;
+    default:
+      read_header (dir->inode, &h);
+      if (lookup (dir, &h, name, &e, NULL, NULL))
+        *inode = inode_open (e.inode_sector);
+      else
+        *inode = NULL;
+      break;
+    }
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
 
+/* Extends directory DIR with zeros, which read as free slots,
+   until it is END bytes long.  Returns false if memory runs out
+   or the disk fills up first, in which case DIR may have grown
+   by some free slots. */
+static bool
+extend_dir (struct dir *dir, off_t end)
+{
+  uint8_t *zeros = calloc (1, BLOCK_SECTOR_SIZE);
+  bool success = zeros != NULL;
+  off_t length;
+
+  while (success && (length = inode_length (dir->inode)) < end)
+    {
+      off_t chunk = BLOCK_SECTOR_SIZE - length % BLOCK_SECTOR_SIZE;
+      success = inode_write_at (dir->inode, zeros, chunk, length) == chunk;
+    }
+  free (zeros);
+  return success;
+}
+
+/* Doubles the number of buckets of hashed directory DIR, whose
+   header is *H, moving each entry whose name now hashes to one
+   of the new buckets there.  Returns false if DIR already has the
+   maximum number of buckets or a disk error occurs.  The new
+   buckets are allocated before any entry moves, so running out of
+   space leaves every entry where the header says it is. */
+static bool
+split_buckets (struct dir *dir, struct dir_header *h)
+{
+  struct dir_bucket *old = malloc (sizeof *old);
+  struct dir_bucket *new = malloc (sizeof *new);
+  unsigned n = h->bucket_cnt;
+  bool success = false;
+  unsigned b;
+  size_t i;
+
+  if (old == NULL || new == NULL || 2 * n > DIR_MAX_BUCKETS
+      || !extend_dir (dir, bucket_ofs (2 * n)))
+    goto done;
+
+  /* The moves and the header that makes them visible go into one
+     journal transaction.  dir_add() already runs inside an
+     operation, so this one nests in it. */
+  journal_begin ();
+  for (b = 0; b < n; b++)
+    {
+      if (inode_read_at (dir->inode, old, sizeof *old, bucket_ofs (b))
+          != sizeof *old)
+        goto done;
+      memset (new, 0, sizeof *new);
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (old->entries[i].in_use
+            && name_bucket (old->entries[i].name, 2 * n) != b)
+          {
+            new->entries[i] = old->entries[i];
+            old->entries[i].in_use = false;
+          }
+      if (inode_write_at (dir->inode, new, sizeof *new, bucket_ofs (b + n))
+          != sizeof *new
+          || inode_write_at (dir->inode, old, sizeof *old, bucket_ofs (b))
+          != sizeof *old)
+        break;
+    }
+  if (b == n)
+    {
+      h->bucket_cnt = 2 * n;
+      success = inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+    }
+  journal_end ();
+
+ done:
+  free (old);
+  free (new);
+  return success;
+}
+
+/* Stores E in a free slot of the bucket its name hashes to in
+   hashed directory DIR, whose header is *H, splitting buckets
+   until there is one.  Returns true if successful, false on
+   failure. */
+static bool
+hashed_add (struct dir *dir, struct dir_header *h, const struct dir_entry *e)
+{
+  struct dir_bucket *bucket = malloc (sizeof *bucket);
+  bool success = false;
+
+  while (bucket != NULL)
+    {
+      unsigned b = name_bucket (e->name, h->bucket_cnt);
+      size_t i;
+
+      if (inode_read_at (dir->inode, bucket, sizeof *bucket, bucket_ofs (b))
+          != sizeof *bucket)
+        break;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (!bucket->entries[i].in_use)
+          break;
+      if (i < BUCKET_ENTRIES)
+        {
+          success = (inode_write_at (dir->inode, e, sizeof *e,
+                                     bucket_ofs (b) + i * sizeof *e)
+                     == sizeof *e);
+          break;
+        }
+      if (!split_buckets (dir, h))
+        break;
+    }
+  free (bucket);
+  return success;
+}
+
+/* Converts linear directory DIR, whose header is *H, to a hashed
+   directory.  Returns true if successful, false on failure, in
+   which case DIR still holds the same entries, though it may have
+   gained free slots at its end. */
+static bool
+convert_to_hashed (struct dir *dir, struct dir_header *h)
+{
+  off_t size = inode_length (dir->inode) - sizeof (struct dir_entry);
+  size_t entry_cnt = size / sizeof (struct dir_entry);
+  struct dir_entry *entries = malloc (entry_cnt * sizeof *entries);
+  struct dir_bucket *buckets = NULL;
+  unsigned bucket_cnt = DIR_MIN_BUCKETS;
+  uint8_t *header_sector = NULL;
+  bool success = false;
+  size_t i, j;
+
+  if (entries == NULL
+      || inode_read_at (dir->inode, entries, entry_cnt * sizeof *entries,
+                        sizeof (struct dir_entry))
+         != (off_t) (entry_cnt * sizeof *entries))
+    goto done;
+
+  /* Sort the entries into buckets in memory, doubling the number
+     of buckets whenever one overflows. */
+ retry:
+  free (buckets);
+  buckets = calloc (bucket_cnt, sizeof *buckets);
+  if (buckets == NULL)
+    goto done;
+  for (i = 0; i < entry_cnt; i++)
+    if (entries[i].in_use)
+      {
+        struct dir_bucket *bucket
+          = &buckets[name_bucket (entries[i].name, bucket_cnt)];
+        for (j = 0; j < BUCKET_ENTRIES && bucket->entries[j].in_use; j++)
+          continue;
+        if (j == BUCKET_ENTRIES)
+          {
+            bucket_cnt *= 2;
+            goto retry;
+          }
+        bucket->entries[j] = entries[i];
+      }
+
+  /* Extend DIR to the size of the hashed directory first.  This
+     is the only step that needs new sectors, so the disk filling
+     up cannot leave DIR half converted. */
+  if (!extend_dir (dir, bucket_ofs (bucket_cnt)))
+    goto done;
+
+  /* Write the buckets over the old entries, then the header and
+     the rest of its sector, which must no longer hold entries. */
+  if (inode_write_at (dir->inode, buckets, bucket_cnt * sizeof *buckets,
+                      bucket_ofs (0))
+      != (off_t) (bucket_cnt * sizeof *buckets))
+    goto done;
+  header_sector = calloc (1, BLOCK_SECTOR_SIZE);
+  if (header_sector == NULL)
+    goto done;
+  h->magic = DIR_HASH_MAGIC;
+  h->bucket_cnt = bucket_cnt;
+  memcpy (header_sector, h, sizeof *h);
+  success = (inode_write_at (dir->inode, header_sector, BLOCK_SECTOR_SIZE, 0)
+             == BLOCK_SECTOR_SIZE);
+
+ done:
+  free (header_sector);
+  free (buckets);
+  free (entries);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -158,6 +526,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is_dir)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -169,46 +538,91 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector, bool is
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock_dir (dir->inode);
+
+  /* Nothing may be added to a removed directory, which would also
+     leave entries cached under its soon to be freed sector. */
+  if (inode_get_removed (dir->inode))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Check that NAME is not in use, and find a free slot for it
+     in the same pass. */
+  read_header (dir->inode, &h);
+  if (lookup (dir, &h, name, NULL, NULL, &ofs) || ofs == SLOT_ERROR)
+    goto done;
 
-  /* Write slot. */
+  if (is_dir) {
+    struct inode *inode = inode_open (inode_sector);
+    if (inode == NULL)
+      goto done;
+    write_header (inode, inode_get_inumber (dir->inode));
+    inode_close (inode);
+  }
+
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
-  if (is_dir) {
-    struct dir_entry f;
-    f.in_use = true;
-    f.parent_sector = inode_get_inumber (dir->inode);
-    struct inode *inode = inode_open (inode_sector);
-    inode_write_at (inode, &f, sizeof f, 0);
-  }
+  /* A full bucket has to be split first. */
+  if (is_hashed (&h) && ofs == -1)
+    {
+      success = hashed_add (dir, &h, &e);
+      goto done;
+    }
+
+  /* Switch to hashing instead of growing past the threshold. */
+  if (!is_hashed (&h) && ofs / (off_t) sizeof e > DIR_HASH_THRESHOLD
+      && convert_to_hashed (dir, &h))
+    {
+      success = hashed_add (dir, &h, &e);
+      goto done;
+    }
+
+  /* Write slot. */
+  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, true, inode_sector);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+/* Returns true if directory INODE holds no entries.  Returns
+   false if it does, or if memory could not be allocated to scan
+   it. */
+static bool
+dir_is_empty (struct inode *inode)
+{
+  struct dir_header h;
+  struct dir_bucket *buf;
+  bool empty = true;
+  off_t ofs = 0;
+  size_t cnt, i;
+
+  buf = malloc (sizeof *buf);
+  if (buf == NULL)
+    return false;
+  read_header (inode, &h);
+  while (empty && (cnt = read_slots (inode, &h, &ofs, buf)) > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        if (buf->entries[i].in_use)
+          empty = false;
+      ofs += cnt * sizeof (struct dir_entry);
+    }
+  free (buf);
+  return empty;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -217,8 +631,11 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  read_header (dir->inode, &h);
+  if (!lookup (dir, &h, name, &e, &ofs, NULL))
     goto done;
 
   /* Open inode. */
@@ -226,48 +643,105 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
   
+  /* A directory stays locked until it is removed, so that nothing
+     is added to it after it was found empty.  Parents are always
+     locked before their children. */
   if (inode_dir (inode)) {
-    off_t offset = 24;
-    while (inode_read_at (inode, &e, sizeof e, offset) == sizeof e) 
-      {
-        offset += sizeof e;
-        if (e.in_use) {
-          goto done;
-        }
-      }
+    inode_lock_dir (inode);
+    if (!dir_is_empty (inode)) {
+      inode_unlock_dir (inode);
+      goto done;
+    }
   }
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
-
-  /* Remove inode. */
-  inode_remove (inode);
-  success = true;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e) 
+    {
+      /* Remove inode. */
+      dcache_insert (inode_get_inumber (dir->inode), name, false, 0);
+      if (inode_dir (inode))
+        dcache_purge (inode_get_inumber (inode));
+      inode_remove (inode);
+      success = true;
+    }
+  if (inode_dir (inode))
+    inode_unlock_dir (inode);
 
  done:
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
+/* Stores up to CNT of the next entries of DIR in ENTS, with each
+   entry's inode number and whether it is a directory.  Returns
+   the number of entries stored, which is less than CNT only at
+   the end of the directory. */
+size_t
+dir_getdents (struct dir *dir, struct dirent *ents, size_t cnt)
+{
+  struct dir_header h;
+  struct dir_bucket *buf;
+  size_t done = 0;
+  size_t slot_cnt, i;
+
+  buf = malloc (sizeof *buf);
+  if (buf == NULL)
+    return 0;
+
+  inode_lock_dir (dir->inode);
+  read_header (dir->inode, &h);
+  while (done < cnt
+         && (slot_cnt = read_slots (dir->inode, &h, &dir->pos, buf)) > 0)
+    for (i = 0; i < slot_cnt && done < cnt; i++)
+      {
+        struct dir_entry *e = &buf->entries[i];
+        dir->pos += sizeof *e;
+        if (e->in_use)
+          {
+            struct dirent *d = &ents[done++];
+            struct inode *inode = inode_open (e->inode_sector);
+            d->inumber = e->inode_sector;
+            d->is_dir = inode != NULL && inode_dir (inode);
+            strlcpy (d->name, e->name, sizeof d->name);
+            inode_close (inode);
+          }
+      }
+  inode_unlock_dir (dir->inode);
+  free (buf);
+  return done;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
-  if (dir->pos == 0 && inode_dir (dir_get_inode (dir)))
-    dir->pos += 24;
+  struct dir_header h;
+  struct dir_bucket *buf;
+  bool found = false;
+  size_t cnt, i;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  buf = malloc (sizeof *buf);
+  if (buf == NULL)
+    return false;
+
+  inode_lock_dir (dir->inode);
+  read_header (dir->inode, &h);
+  while (!found && (cnt = read_slots (dir->inode, &h, &dir->pos, buf)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        struct dir_entry *e = &buf->entries[i];
+        dir->pos += sizeof *e;
+        if (e->in_use)
+          {
+            strlcpy (name, e->name, NAME_MAX + 1);
+            found = true;
+            break;
+          }
+      }
+  inode_unlock_dir (dir->inode);
+  free (buf);
+  return found;
 }
@@ -3,9 +3,11 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/thread.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 
 /* Partition that contains the file system. */
@@ -21,13 +23,29 @@ filesys_init (bool format)
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
+  cache_flusher_start (fs_device);
+  cache_readahead_start (fs_device);
 
   inode_init ();
-  lock_init (&filesys_lock);
+  dcache_init ();
   free_map_init ();
 
   if (format) 
-    do_format ();
+    {
+      do_format ();
+      journal_init (true);
+    }
+  else
+    {
+      journal_init (false);
+
+      /* New files take the format the disk was formatted with. */
+      struct inode *root = inode_open (ROOT_DIR_SECTOR);
+      if (root == NULL)
+        PANIC ("root directory open failed");
+      inode_set_format (inode_get_format (root));
+      inode_close (root);
+    }
 
   struct thread *cur = thread_current ();
   cur->cwd = dir_open_root ();
@@ -40,10 +58,28 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-  cache_flush (fs_device);
+  journal_done ();
   free_map_close ();
+  cache_flush (fs_device);
 }
 
+/* Frees the inode sector SECTOR, allocated for a file that could
+   not be created.  If CREATED is true, the inode was written, and
+   the data and index sectors it allocated are freed with it. */
+static void
+release_inode (block_sector_t sector, bool created)
+{
+  struct inode *inode = created ? inode_open (sector) : NULL;
+
+  if (inode != NULL)
+    {
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else
+    free_map_release (sector, 1);
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -53,16 +89,19 @@ filesys_create (const char *name, off_t initial_size)
 {
   block_sector_t inode_sector = 0;
   struct thread *cur = thread_current ();
-  struct dir *dir = dir_reopen (cur->cwd);
+  struct dir *dir;
 
+  journal_begin ();
+  dir = dir_reopen (cur->cwd);
   size_t index = 0;
-  bool success = (dir != NULL
+  bool created = (dir != NULL
                   && free_map_allocate (&inode_sector, &index)
-                  && inode_create (inode_sector, initial_size, false)
-                  && dir_add (dir, name, inode_sector, false));
+                  && inode_create (inode_sector, initial_size, false));
+  bool success = created && dir_add (dir, name, inode_sector, false);
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    release_inode (inode_sector, created);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -73,12 +112,15 @@ filesys_create_dir (const char *name, void *dir_ptr, off_t initial_size, bool is
   block_sector_t inode_sector = 0;
   struct dir *dir = (struct dir *) dir_ptr;
   size_t index = 0;
-  bool success = (dir != NULL
+
+  journal_begin ();
+  bool created = (dir != NULL
                   && free_map_allocate (&inode_sector, &index)
-                  && inode_create (inode_sector, initial_size, is_dir)
-                  && dir_add (dir, name, inode_sector, is_dir));
+                  && inode_create (inode_sector, initial_size, is_dir));
+  bool success = created && dir_add (dir, name, inode_sector, is_dir);
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    release_inode (inode_sector, created);
+  journal_end ();
 
   return success;
 }
@@ -124,9 +166,14 @@ filesys_open_dir (const char *name, void *dir_ptr)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
@@ -135,12 +182,27 @@ bool
 filesys_remove_dir (const char *name, void *dir_ptr) 
 {
   struct dir *dir = (struct dir *) dir_ptr;
-  bool success = dir != NULL && dir_remove (dir, name);
+  bool success;
+
+  journal_begin ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
 
+/* Writes all file data to disk and commits the journal, writing
+   the cache back once more if the commit could not carry all of
+   the metadata. */
+void
+filesys_sync (void)
+{
+  cache_flush (fs_device);
+  if (!journal_commit ())
+    cache_flush (fs_device);
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
@@ -9,10 +9,10 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* First sector of the journal. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
-struct lock filesys_lock;
 
 void filesys_init (bool format);
 void filesys_done (void);
@@ -22,5 +22,6 @@ struct file *filesys_open (const char *name);
 struct file *filesys_open_dir (const char *name, void *dir_ptr);
 bool filesys_remove (const char *name);
 bool filesys_remove_dir (const char *name, void *dir_ptr);
+void filesys_sync (void);
 
 #endif /* filesys/filesys.h */
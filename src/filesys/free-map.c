@@ -1,12 +1,23 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty_map;     /* One bit per free map file sector
+                                        changed since last written. */
+static struct lock free_map_lock;    /* Guards both bitmaps. */
+
+/* Number of free map bits stored in one sector of its file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+static void mark_dirty (block_sector_t, size_t);
 
 /* Initializes the free map. */
 void
@@ -15,45 +26,138 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                           BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+}
+
+/* Allocates a sector from the free map and stores it into
+   *SECTORP, searching from *INDEX first and then advancing
+   *INDEX past the sector allocated.
+   Returns true if successful, false if the disk is full. */
+bool
+free_map_allocate (block_sector_t *sectorp, size_t *index)
+{
+  return free_map_allocate_run (1, sectorp, index) == 1;
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+/* Finds the longest run of free sectors in the free map, and
+   stores its first sector into *START.  Returns the run's length,
+   or 0 if no sector is free. */
+static size_t
+longest_free_run (size_t *start)
+{
+  size_t size = bitmap_size (free_map);
+  size_t best = 0;
+  size_t pos = 0;
+
+  while (pos < size)
+    {
+      size_t first = bitmap_scan (free_map, pos, 1, false);
+      size_t last;
+
+      if (first == BITMAP_ERROR)
+        break;
+      last = bitmap_scan (free_map, first, 1, true);
+      if (last == BITMAP_ERROR)
+        last = size;
+      if (last - first > best)
+        {
+          best = last - first;
+          *start = first;
+        }
+      pos = last;
+    }
+  return best;
+}
 
-bool free_map_allocate (block_sector_t *sectorp, size_t *index)
+/* Allocates up to CNT consecutive sectors from the free map in a
+   single bitmap update and stores the first into *SECTORP.
+   Prefers a run of exactly CNT sectors at or after *INDEX, then
+   anywhere on disk; failing both, takes the longest free run.
+   Advances *INDEX past the run.
+   Returns the number of sectors allocated, which is 0 if the
+   disk is full.  The change reaches the free map file at the
+   next free_map_flush(). */
+size_t
+free_map_allocate_run (size_t cnt, block_sector_t *sectorp, size_t *index)
 {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, *index, 1, false);
-  if (sector == BITMAP_ERROR) {
-    sector = bitmap_scan_and_flip(free_map, 0, 1, false);
-  }
-
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file))
-  {
-    bitmap_set_multiple(free_map, sector, 1, false);
-    sector = BITMAP_ERROR;
-  }
-  
+  size_t sector;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, *index, cnt, false);
   if (sector == BITMAP_ERROR)
-    return false;
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  if (sector == BITMAP_ERROR)
+    {
+      size_t longest = longest_free_run (&sector);
+      if (longest == 0)
+        {
+          lock_release (&free_map_lock);
+          return 0;
+        }
+      if (longest < cnt)
+        cnt = longest;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+    }
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
 
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  *index = sector + 1;
-  return sector != BITMAP_ERROR;
+  *sectorp = sector;
+  *index = sector + cnt;
+  return cnt;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Notes that the free map file sectors holding the bits for CNT
+   sectors starting at SECTOR need to be written.  The caller must
+   hold FREE_MAP_LOCK. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Writes the free map file sectors changed since they were last
+   written.  The writes go to the buffer cache, and join the
+   journal transaction that is committing. */
+void
+free_map_flush (void)
+{
+  size_t i;
+
+  if (free_map_file == NULL)
+    return;
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < bitmap_size (dirty_map); i++)
+    if (bitmap_test (dirty_map, i))
+      {
+        if (!bitmap_write_part (free_map, free_map_file,
+                                i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+          PANIC ("can't write free map");
+        bitmap_reset (dirty_map, i);
+      }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -65,13 +169,16 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_map, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -89,4 +196,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
 }
@@ -1,12 +1,16 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -221,3 +225,104 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Number of cache hits timed for each cache size. */
+#define CACHE_BENCH_LOOKUPS 200000
+
+/* Times buffer cache hits with the cache rebuilt at 64, 256,
+   1024, and 4096 entries, then restores the original size.  Each
+   run first touches as many distinct file system sectors as the
+   cache holds, so every timed lookup is a hit.  A size that does
+   not fit in kernel memory is cut down to what does, and timed at
+   that size (use the pintos -m option for the larger ones). */
+void
+fsutil_cache_bench (char **argv UNUSED)
+{
+  static const size_t sizes[] = {64, 256, 1024, 4096};
+  size_t old_size = cache_size ();
+  size_t i;
+
+  printf ("Timing %d buffer cache hits per cache size...\n",
+          CACHE_BENCH_LOOKUPS);
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t cnt = sizes[i];
+      block_sector_t sector;
+      uint32_t word;
+      int64_t start;
+      int n;
+
+      if (cnt > block_size (fs_device))
+        cnt = block_size (fs_device);
+
+      /* The cache cannot be resized with a transaction open. */
+      journal_commit ();
+      cnt = cache_resize (fs_device, cnt);
+
+      for (sector = 0; sector < cnt; sector++)
+        cache_read (fs_device, sector, &word, sizeof word, 0);
+
+      start = timer_ticks ();
+      for (n = 0; n < CACHE_BENCH_LOOKUPS; n++)
+        cache_read (fs_device, n % cnt, &word, sizeof word, 0);
+      printf ("%5zu entries: %"PRId64" ticks\n", cnt, timer_elapsed (start));
+    }
+  journal_commit ();
+  cache_resize (fs_device, old_size);
+}
+
+/* Number of files and sectors per file used by alloc-bench. */
+#define ALLOC_BENCH_FILES 4
+#define ALLOC_BENCH_SECTORS 256
+
+/* Times file creation and growth, which are dominated by free
+   map updates: first creating files at full size in one call,
+   then growing files from empty one sector-sized write at a time.
+   The files are removed afterward. */
+void
+fsutil_alloc_bench (char **argv UNUSED)
+{
+  static char sector[BLOCK_SECTOR_SIZE];
+  char name[16];
+  int64_t start;
+  int i, j;
+
+  printf ("Creating %d files of %d sectors...\n",
+          ALLOC_BENCH_FILES, ALLOC_BENCH_SECTORS);
+  start = timer_ticks ();
+  for (i = 0; i < ALLOC_BENCH_FILES; i++)
+    {
+      snprintf (name, sizeof name, "bench-c%d", i);
+      if (!filesys_create (name, ALLOC_BENCH_SECTORS * BLOCK_SECTOR_SIZE))
+        PANIC ("%s: create failed", name);
+    }
+  printf ("create: %"PRId64" ticks\n", timer_elapsed (start));
+
+  printf ("Growing %d files to %d sectors...\n",
+          ALLOC_BENCH_FILES, ALLOC_BENCH_SECTORS);
+  start = timer_ticks ();
+  for (i = 0; i < ALLOC_BENCH_FILES; i++)
+    {
+      struct file *file;
+
+      snprintf (name, sizeof name, "bench-g%d", i);
+      if (!filesys_create (name, 0))
+        PANIC ("%s: create failed", name);
+      file = filesys_open (name);
+      if (file == NULL)
+        PANIC ("%s: open failed", name);
+      for (j = 0; j < ALLOC_BENCH_SECTORS; j++)
+        if (file_write (file, sector, sizeof sector) != sizeof sector)
+          PANIC ("%s: write failed", name);
+      file_close (file);
+    }
+  printf ("extend: %"PRId64" ticks\n", timer_elapsed (start));
+
+  for (i = 0; i < ALLOC_BENCH_FILES; i++)
+    {
+      snprintf (name, sizeof name, "bench-c%d", i);
+      filesys_remove (name);
+      snprintf (name, sizeof name, "bench-g%d", i);
+      filesys_remove (name);
+    }
+}
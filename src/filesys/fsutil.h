@@ -6,5 +6,7 @@ void fsutil_cat (char **argv);
 void fsutil_rm (char **argv);
 void fsutil_extract (char **argv);
 void fsutil_append (char **argv);
+void fsutil_cache_bench (char **argv);
+void fsutil_alloc_bench (char **argv);
 
 #endif /* filesys/fsutil.h */
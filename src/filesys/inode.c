@@ -1,28 +1,66 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 #define MAX_SECTOR_SIZE 128 * 128 + 128 + 123
 
+/* Number of sectors to read ahead of a sequential reader. */
+#define READ_AHEAD_SECTORS 8
+
+/* Number of extents in an INODE_EXTENTS inode. */
+#define EXTENT_CNT 41
+
+/* Largest file, in bytes, kept inside an INODE_INLINE inode. */
+#define INLINE_MAX 500
+
+/* A run of LENGTH consecutive disk sectors, starting at START,
+   that holds sectors FILE_START onward of a file. */
+struct extent
+  {
+    uint32_t file_start;                /* First file sector index. */
+    block_sector_t start;               /* First disk sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   FORMAT selects how data sectors are mapped: INODE_INDEXED
+   inodes use the direct and indirect pointers, INODE_EXTENTS
+   inodes use the extent table, sorted by FILE_START, and
+   INODE_INLINE inodes hold the file's bytes in INLINE_DATA. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     bool dir;                           /* Is directory flag */
+    uint8_t format;                     /* An enum inode_format. */
+    uint8_t unused[2];
 
-    block_sector_t direct[123];
-    block_sector_t s_indirect;
-    block_sector_t d_indirect;
+    union
+      {
+        struct
+          {
+            block_sector_t direct[123];
+            block_sector_t s_indirect;
+            block_sector_t d_indirect;
+          };
+        struct
+          {
+            uint32_t extent_cnt;        /* Number of extents in use. */
+            struct extent extents[EXTENT_CNT];
+          };
+        uint8_t inline_data[INLINE_MAX];
+      };
   };
 
 struct indirect
@@ -41,26 +79,53 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode table. */
+    struct list_elem elem;              /* Element in closed inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* Inode sector still being read? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
-    struct lock inode_lock;
+    struct rwlock rwlock;               /* Shared to access data, exclusive
+                                           to change DATA. */
+    struct lock dir_lock;               /* Serializes directory updates. */
+    size_t ra_next;                     /* Sector index after last read. */
+    size_t ra_end;                      /* Sector index after last read ahead. */
+    size_t leaf_idx;                    /* Last doubly-indirect slot resolved. */
+    block_sector_t leaf_sector;         /* Indirect block in that slot. */
+    struct lock leaf_lock;              /* Guards LEAF_IDX and LEAF_SECTOR
+                                           among readers. */
   };
 
-static struct indirect *read_indirect (block_sector_t sector);
-static void inode_allocate(struct inode_disk *, size_t, size_t);
+static bool inode_allocate(struct inode_disk *, size_t, size_t,
+                           size_t, size_t, block_sector_t);
+static bool indexed_allocate (struct inode_disk *, size_t, size_t,
+                              size_t, size_t, block_sector_t);
+static bool extent_allocate (struct inode_disk *, size_t, size_t,
+                             size_t, size_t, block_sector_t);
+static void zero_sector (block_sector_t, size_t, size_t, size_t,
+                         block_sector_t);
+static void inode_deallocate (struct inode_disk *);
+static bool inode_uninline (struct inode *);
+static void inode_read_ahead (struct inode *, off_t, off_t);
 
-static struct indirect *read_indirect (block_sector_t sector) {
-  struct indirect *block = calloc (1, sizeof (struct indirect));
-  cache_read (fs_device, sector, block, BLOCK_SECTOR_SIZE, 0);
-  return block;
-}
+/* Sector number that marks a hole in a file's data map: a range
+   of the file that reads as zeros and has no sectors allocated.
+   Sector 0 holds the free map inode, so it is never file data. */
+#define HOLE_SECTOR 0
 
+/* Format of newly created inodes. */
+static enum inode_format new_format = INODE_INDEXED;
+
+/* Returns the disk sector holding byte POS of INODE, -1 if POS
+   is past end of file, or HOLE_SECTOR if POS lies in a hole.
+   Each indirect level costs one cache lookup that copies out
+   only the needed pointer, and the doubly-indirect level is
+   skipped while POS stays within the same second-level block as
+   the previous call. */
 static block_sector_t
-new_byte_to_sector (const struct inode *inode, off_t pos) 
+new_byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   int sectors = pos / BLOCK_SECTOR_SIZE;
@@ -75,131 +140,515 @@ new_byte_to_sector (const struct inode *inode, off_t pos)
   }
   else if (sectors < 123 + 128)
   {
-    block_sector_t s_indirect = inode->data.s_indirect;
-    struct indirect *block = read_indirect (s_indirect);
-    block_sector_t sector = block->blocks[sectors - 123];
-    free (block);
-    return sector;
+    if ((int) inode->data.s_indirect == -1)
+      return HOLE_SECTOR;
+    return cache_read_index (fs_device, inode->data.s_indirect, sectors - 123);
   }
   else if (sectors < 123 + 128 + 128 * 128)
   {
-    block_sector_t d_indirect_1 = inode->data.d_indirect;
-    struct indirect *block_1 = read_indirect (d_indirect_1);
-    block_sector_t d_indirect_2 = (sectors - 123 - 128) / 128;
+    size_t d_indirect_2 = (sectors - 123 - 128) / 128;
     int offset = (sectors - 123 - 128) % 128;
-    struct indirect *block_2 = read_indirect (block_1->blocks[d_indirect_2]);
-    block_sector_t sector = block_2->blocks[offset];
-    free(block_1);
-    free(block_2);
-    return sector;
+    block_sector_t leaf = -1;
+
+    /* Readers share the leaf cache, so its two fields are read
+       and updated under LEAF_LOCK. */
+    lock_acquire (&inode->leaf_lock);
+    if (inode->leaf_idx == d_indirect_2)
+      leaf = inode->leaf_sector;
+    lock_release (&inode->leaf_lock);
+
+    if ((int) leaf == -1)
+      {
+        if ((int) inode->data.d_indirect == -1)
+          return HOLE_SECTOR;
+        leaf = cache_read_index (fs_device, inode->data.d_indirect, d_indirect_2);
+        if ((int) leaf == -1)
+          return HOLE_SECTOR;
+        lock_acquire (&inode->leaf_lock);
+        inode->leaf_sector = leaf;
+        inode->leaf_idx = d_indirect_2;
+        lock_release (&inode->leaf_lock);
+      }
+    return cache_read_index (fs_device, leaf, offset);
   }
   else {
     PANIC ("file size is too big");
   }
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns the disk sector holding byte POS of extent-mapped
+   INODE, -1 if POS is past end of file, or HOLE_SECTOR if POS
+   lies between extents.  Stores into *RUN the number of sectors,
+   starting with that one, that follow it contiguously on disk,
+   or that follow it in the same hole. */
+static block_sector_t
+extent_byte_to_sector (const struct inode *inode, off_t pos, size_t *run)
+{
+  const struct inode_disk *disk_inode = &inode->data;
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  size_t i;
+
+  if (0 > pos || pos >= disk_inode->length)
+    return -1;
+
+  for (i = 0; i < disk_inode->extent_cnt; i++)
+    {
+      const struct extent *e = &disk_inode->extents[i];
+      if (idx < e->file_start)
+        {
+          *run = e->file_start - idx;
+          return HOLE_SECTOR;
+        }
+      if (idx < e->file_start + e->length)
+        {
+          *run = e->file_start + e->length - idx;
+          return e->start + (idx - e->file_start);
+        }
+    }
+  *run = bytes_to_sectors (disk_inode->length) - idx;
+  return HOLE_SECTOR;
+}
+
+/* Returns the disk sector holding byte POS of INODE, -1 if POS
+   is past end of file, or HOLE_SECTOR if POS lies in a hole.  If
+   RUN is non-null, stores into it the number of sectors, starting
+   with that one, that are known to follow it contiguously on disk
+   (or in the same hole), so that the caller can skip the lookups
+   for them. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos, size_t *run)
+{
+  size_t dummy;
+
+  if (run == NULL)
+    run = &dummy;
+  if (inode->data.format == INODE_EXTENTS)
+    return extent_byte_to_sector (inode, pos, run);
+
+  *run = 1;
+  return new_byte_to_sector (inode, pos);
+}
+
+/* Maximum number of closed inodes kept in memory. */
+#define CLOSED_INODE_MAX 64
+
+/* Table of in-memory inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.  Besides the
+   open inodes, it holds up to CLOSED_INODE_MAX recently closed
+   ones, which are also on CLOSED_INODES in order of closing so
+   that reopening them does not read the inode sector again.
+   INODE_TABLE_LOCK guards both and every inode's OPEN_CNT and
+   LOADING, but is not held during disk I/O: an inode enters the
+   table before its sector has been read, and openers that find
+   it still loading wait on INODE_LOADED. */
+static struct hash inode_table;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock inode_table_lock;
+static struct condition inode_loaded;
+
+static unsigned
+inode_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, hash_elem);
+  return hash_int (inode->sector);
+}
+
+static bool
+inode_less_func (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inode_table, inode_hash_func, inode_less_func, NULL);
+  list_init (&closed_inodes);
+  lock_init (&inode_table_lock);
+  cond_init (&inode_loaded);
 }
 
+/* Allocates and zeroes data sectors for the holes among the
+   SECTORS file sectors of DISK_INODE that start at START_SECTOR,
+   using the inode's format.  File sectors WRITE_START up to
+   WRITE_END are about to be overwritten in full by the caller, so
+   they are not zeroed.  The zeroed sectors are file data of the
+   inode at sector OWNER.  Returns false if the disk filled up, in
+   which case some of the holes may remain. */
+static bool
+inode_allocate (struct inode_disk *disk_inode, size_t start_sector, size_t sectors,
+                size_t write_start, size_t write_end, block_sector_t owner)
+{
+  if (disk_inode->format == INODE_EXTENTS)
+    return extent_allocate (disk_inode, start_sector, sectors,
+                            write_start, write_end, owner);
+  return indexed_allocate (disk_inode, start_sector, sectors,
+                           write_start, write_end, owner);
+}
+
+/* Zeroes new data SECTOR, which holds file sector IDX of the
+   inode at sector OWNER, unless IDX is between WRITE_START and
+   WRITE_END. */
 static void
-inode_allocate (struct inode_disk *disk_inode, size_t start_sector, size_t sectors)
+zero_sector (block_sector_t sector, size_t idx,
+             size_t write_start, size_t write_end, block_sector_t owner)
 {
   static char zeros[BLOCK_SECTOR_SIZE];
-  size_t index = 0;
-  
-  if (sectors > MAX_SECTOR_SIZE) PANIC ("file size is too big");
-  
-  if (sectors > 0 && start_sector < 123)
+
+  if (idx < write_start || idx >= write_end)
+    cache_write_owned (fs_device, sector, zeros, BLOCK_SECTOR_SIZE, 0, owner);
+}
+
+/* Sectors reserved from the free map in runs, so that a file
+   grown by many sectors takes one bitmap scan per run instead of
+   one per sector and its data lands contiguously. */
+struct sector_run
+  {
+    block_sector_t next;        /* Next unused sector of the run. */
+    size_t left;                /* Unused sectors left in the run. */
+    size_t want;                /* Sectors the caller still expects. */
+    size_t hint;                /* Where to search for the next run. */
+  };
+
+/* Returns the next sector of RUN, reserving a new run of up to
+   RUN->want sectors when the current one is used up, or -1 if
+   the disk is full. */
+static block_sector_t
+run_next (struct sector_run *run)
+{
+  if (run->left == 0)
     {
-      // up to 123 direct blocks allocate & write zeros
-      size_t start_idx = start_sector;
-      size_t inode_count = start_idx + sectors <= 123 ? start_idx + sectors : 123;
-      for (size_t i = start_idx; i < inode_count; i++)
-        {
-          free_map_allocate (&disk_inode->direct[i], &index);
-          cache_write (fs_device, disk_inode->direct[i], zeros, BLOCK_SECTOR_SIZE, 0);
-          start_sector++;
-          sectors--;
-        }
+      run->left = free_map_allocate_run (run->want > 0 ? run->want : 1,
+                                         &run->next, &run->hint);
+      if (run->left == 0)
+        return -1;
     }
-  if (sectors > 0 && start_sector < 123 + 128)
+  if (run->want > 0)
+    run->want--;
+  run->left--;
+  return run->next++;
+}
+
+/* Returns the sectors of RUN that were reserved but not used to
+   the free map. */
+static void
+run_finish (struct sector_run *run)
+{
+  if (run->left > 0)
+    free_map_release (run->next, run->left);
+  run->left = 0;
+}
+
+/* If *SECTORP, which maps file sector IDX, is a hole, replaces it
+   by a zeroed sector from RUN.  Returns false if the disk is
+   full. */
+static bool
+fill_hole (block_sector_t *sectorp, size_t idx, struct sector_run *run,
+           size_t write_start, size_t write_end, block_sector_t owner)
+{
+  block_sector_t sector;
+
+  if (*sectorp != HOLE_SECTOR)
+    return true;
+  sector = run_next (run);
+  if ((int) sector == -1)
+    return false;
+  *sectorp = sector;
+  zero_sector (sector, idx, write_start, write_end, owner);
+  return true;
+}
+
+/* Fills the holes among entries FIRST up to LAST of the indirect
+   block at *BLOCKP, whose entry 0 maps file sector BASE.  The
+   block itself is allocated first if *BLOCKP is -1.  Returns
+   false if the disk is full. */
+static bool
+indirect_allocate (block_sector_t *blockp, size_t base, size_t first,
+                   size_t last, struct sector_run *run,
+                   size_t write_start, size_t write_end, block_sector_t owner)
+{
+  struct indirect *indirect = calloc (1, sizeof (struct indirect));
+  bool success = true;
+  size_t i;
+
+  if (indirect == NULL)
+    return false;
+  if ((int) *blockp != -1)
+    cache_read (fs_device, *blockp, indirect, BLOCK_SECTOR_SIZE, 0);
+  else
     {
-      // up to 128 singly indirect blocks allocate & write zeros
-      // s_indirect block allocate & write
-      struct indirect *s_indirect = calloc (1, sizeof (struct indirect));
-      if ( (int) disk_inode->s_indirect != -1) 
-        cache_read (fs_device, disk_inode->s_indirect, s_indirect, BLOCK_SECTOR_SIZE, 0);
-
-      size_t start_idx = start_sector - 123;
-      size_t inode_count = start_idx + sectors <= 128 ? start_idx + sectors : 128;
-      for (size_t i = start_idx; i < inode_count; i++)
+      *blockp = run_next (run);
+      if ((int) *blockp == -1)
         {
-          free_map_allocate (&s_indirect->blocks[i], &index);
-          cache_write (fs_device, s_indirect->blocks[i], zeros, BLOCK_SECTOR_SIZE, 0);
-          start_sector++;
-          sectors--;
+          free (indirect);
+          return false;
         }
-      if ( (int) disk_inode->s_indirect == -1) 
-        free_map_allocate (&disk_inode->s_indirect, &index);
-      cache_write (fs_device, disk_inode->s_indirect, s_indirect, BLOCK_SECTOR_SIZE, 0);
-      free (s_indirect);
     }
-  if (sectors > 0 && start_sector < 123 + 128 + 128 * 128)
+
+  for (i = first; i < last && success; i++)
+    success = fill_hole (&indirect->blocks[i], base + i, run,
+                         write_start, write_end, owner);
+  journal_write (*blockp, indirect, BLOCK_SECTOR_SIZE, 0);
+  free (indirect);
+  return success;
+}
+
+/* Fills holes for indexed DISK_INODE.  Unallocated direct and
+   indirect entries are holes; an indirect block that was never
+   allocated is a hole as a whole. */
+static bool
+indexed_allocate (struct inode_disk *disk_inode, size_t start_sector, size_t sectors,
+                  size_t write_start, size_t write_end, block_sector_t owner)
+{
+  struct sector_run run = { .want = sectors };
+  size_t end = start_sector + sectors;
+  bool success = true;
+
+  if (end > MAX_SECTOR_SIZE) PANIC ("file size is too big");
+
+  // up to 123 direct blocks
+  for (; success && start_sector < end && start_sector < 123; start_sector++)
+    success = fill_hole (&disk_inode->direct[start_sector], start_sector,
+                         &run, write_start, write_end, owner);
+
+  // up to 128 singly indirect blocks
+  if (success && start_sector < end && start_sector < 123 + 128)
     {
-      // up to 128*128 doubly indirect blocks allocate & write zeros
-      // up to 128 indirect blocks allocate & write
-      // d_indirect block allocate & write
+      size_t last = end < 123 + 128 ? end : 123 + 128;
+      success = indirect_allocate (&disk_inode->s_indirect, 123,
+                                   start_sector - 123, last - 123, &run,
+                                   write_start, write_end, owner);
+      start_sector = last;
+    }
 
+  // up to 128*128 doubly indirect blocks
+  if (success && start_sector < end)
+    {
       struct indirect *d_indirect = calloc (1, sizeof (struct indirect));
-      if ( (int) disk_inode->d_indirect != -1) 
+      if (d_indirect == NULL)
+        success = false;
+      else if ( (int) disk_inode->d_indirect != -1) 
         cache_read (fs_device, disk_inode->d_indirect, d_indirect, BLOCK_SECTOR_SIZE, 0);
       else {
         for (int i = 0; i < 128; i++)
           d_indirect->blocks[i] = -1;
+        disk_inode->d_indirect = run_next (&run);
+        success = (int) disk_inode->d_indirect != -1;
       }
 
-      size_t start_idx = start_sector - 123 - 128;
-      size_t end_idx = start_idx + sectors - 1;
-      size_t start_indirect_sector = start_idx / 128;
-      size_t start_indirect_offset = start_idx % 128;
-      size_t end_indirect_sector = end_idx / 128;
-      size_t end_indirect_offset = end_idx % 128;
+      while (success && start_sector < end)
+        {
+          size_t idx = start_sector - 123 - 128;
+          size_t first = idx % 128;
+          size_t last = first + (end - start_sector) < 128
+                        ? first + (end - start_sector) : 128;
+          success = indirect_allocate (&d_indirect->blocks[idx / 128],
+                                       start_sector - first, first, last,
+                                       &run, write_start, write_end, owner);
+          start_sector += last - first;
+        }
+      /* Without a buffer, there is nothing to write back. */
+      if (d_indirect != NULL && (int) disk_inode->d_indirect != -1)
+        journal_write (disk_inode->d_indirect, d_indirect, BLOCK_SECTOR_SIZE, 0);
+      free (d_indirect);
+    }
+
+  run_finish (&run);
+  return success;
+}
+
+/* Maps the CNT file sectors of extent-mapped DISK_INODE that
+   start at FILE_START to the disk sectors starting at SECTOR.
+   The sectors must be a hole.  Grows the neighboring extents
+   when the new sectors continue them on disk; otherwise inserts
+   a new extent.  Returns false if the extent table is full. */
+static bool
+extent_insert (struct inode_disk *disk_inode, size_t file_start,
+               block_sector_t sector, size_t cnt)
+{
+  struct extent *extents = disk_inode->extents;
+  size_t i = 0;
+  bool prev_joins, next_joins;
+
+  while (i < disk_inode->extent_cnt && extents[i].file_start < file_start)
+    i++;
+  prev_joins = (i > 0
+                && extents[i - 1].file_start + extents[i - 1].length == file_start
+                && extents[i - 1].start + extents[i - 1].length == sector);
+  next_joins = (i < disk_inode->extent_cnt
+                && file_start + cnt == extents[i].file_start
+                && sector + cnt == extents[i].start);
+
+  if (prev_joins && next_joins)
+    {
+      extents[i - 1].length += cnt + extents[i].length;
+      memmove (&extents[i], &extents[i + 1],
+               (disk_inode->extent_cnt - i - 1) * sizeof *extents);
+      disk_inode->extent_cnt--;
+    }
+  else if (prev_joins)
+    extents[i - 1].length += cnt;
+  else if (next_joins)
+    {
+      extents[i].file_start = file_start;
+      extents[i].start = sector;
+      extents[i].length += cnt;
+    }
+  else if (disk_inode->extent_cnt < EXTENT_CNT)
+    {
+      memmove (&extents[i + 1], &extents[i],
+               (disk_inode->extent_cnt - i) * sizeof *extents);
+      extents[i].file_start = file_start;
+      extents[i].start = sector;
+      extents[i].length = cnt;
+      disk_inode->extent_cnt++;
+    }
+  else
+    return false;
+  return true;
+}
 
-      for (size_t i = start_indirect_sector; i <= end_indirect_sector; i++)
+/* Fills holes for extent-mapped DISK_INODE, reserving each
+   hole's sectors from the free map a run at a time.  Fails if
+   the extent table fills up or the disk is full. */
+static bool
+extent_allocate (struct inode_disk *disk_inode, size_t start_sector, size_t sectors,
+                 size_t write_start, size_t write_end, block_sector_t owner)
+{
+  size_t next = start_sector;
+  size_t end = start_sector + sectors;
+  size_t hint = 0;
+  size_t i = 0;
+
+  while (next < end)
+    {
+      const struct extent *e;
+      size_t hole_end = end;
+      block_sector_t sector;
+      size_t cnt, j;
+
+      /* Skip extents that end before NEXT, then past one that
+         covers it. */
+      while (i < disk_inode->extent_cnt
+             && disk_inode->extents[i].file_start
+                + disk_inode->extents[i].length <= next)
+        i++;
+      e = i < disk_inode->extent_cnt ? &disk_inode->extents[i] : NULL;
+      if (e != NULL && e->file_start <= next)
         {
-          struct indirect *indirect = calloc (1, sizeof (struct indirect));
-          if ((int)d_indirect->blocks[i] != -1) 
-            cache_read (fs_device, d_indirect->blocks[i], indirect, BLOCK_SECTOR_SIZE, 0);
+          next = e->file_start + e->length;
+          continue;
+        }
+      if (e != NULL && e->file_start < hole_end)
+        hole_end = e->file_start;
+      if (i > 0)
+        hint = disk_inode->extents[i - 1].start + disk_inode->extents[i - 1].length;
 
-          size_t start = i == start_indirect_sector ? start_indirect_offset : 0;
-          size_t end = i == end_indirect_sector ? end_indirect_offset : 127;
-          for (size_t j = start; j <= end; j++)
-            {
-              free_map_allocate (&indirect->blocks[j], &index);
-              cache_write (fs_device, indirect->blocks[j], zeros, BLOCK_SECTOR_SIZE, 0);
-              start_sector++;
-              sectors--;
-            }
-          if ((int)d_indirect->blocks[i] == -1) 
-            free_map_allocate (&d_indirect->blocks[i], &index);
+      cnt = free_map_allocate_run (hole_end - next, &sector, &hint);
+      if (cnt == 0)
+        return false;
+      if (!extent_insert (disk_inode, next, sector, cnt))
+        {
+          free_map_release (sector, cnt);
+          return false;
+        }
+      for (j = 0; j < cnt; j++)
+        zero_sector (sector + j, next + j, write_start, write_end, owner);
+      next += cnt;
+    }
+  return true;
+}
 
-          cache_write (fs_device, d_indirect->blocks[i], indirect, BLOCK_SECTOR_SIZE, 0);
-          free (indirect);
+/* Sectors being returned to the free map, gathered into runs of
+   consecutive sectors so that each run takes one bitmap update. */
+struct sector_batch
+  {
+    block_sector_t start;       /* First sector of the pending run. */
+    size_t cnt;                 /* Sectors in the pending run. */
+  };
+
+/* Releases the pending run of BATCH to the free map. */
+static void
+batch_flush (struct sector_batch *batch)
+{
+  if (batch->cnt > 0)
+    free_map_release (batch->start, batch->cnt);
+  batch->cnt = 0;
+}
+
+/* Adds CNT sectors starting at SECTOR to BATCH, releasing its
+   pending run first unless they extend it. */
+static void
+batch_release (struct sector_batch *batch, block_sector_t sector, size_t cnt)
+{
+  if (batch->cnt > 0 && batch->start + batch->cnt == sector)
+    batch->cnt += cnt;
+  else
+    {
+      batch_flush (batch);
+      batch->start = sector;
+      batch->cnt = cnt;
+    }
+}
+
+/* Adds the data sectors mapped by the indirect block at SECTOR,
+   then the block itself, to BATCH. */
+static void
+indirect_release (struct sector_batch *batch, block_sector_t sector)
+{
+  block_sector_t blocks[128];
+  size_t i;
+
+  cache_read (fs_device, sector, blocks, BLOCK_SECTOR_SIZE, 0);
+  for (i = 0; i < 128; i++)
+    if (blocks[i] != HOLE_SECTOR)
+      batch_release (batch, blocks[i], 1);
+  batch_release (batch, sector, 1);
+}
+
+/* Returns every data and index sector of DISK_INODE to the free
+   map, walking the whole map rather than just the part below the
+   file's length so that sectors left beyond it by a failed write
+   are reclaimed too. */
+static void
+inode_deallocate (struct inode_disk *disk_inode)
+{
+  struct sector_batch batch = { .cnt = 0 };
+  size_t i;
+
+  if (disk_inode->format == INODE_INLINE)
+    return;
+  if (disk_inode->format == INODE_EXTENTS)
+    {
+      for (i = 0; i < disk_inode->extent_cnt; i++)
+        batch_release (&batch, disk_inode->extents[i].start,
+                       disk_inode->extents[i].length);
+      disk_inode->extent_cnt = 0;
+    }
+  else
+    {
+      for (i = 0; i < 123; i++)
+        if (disk_inode->direct[i] != HOLE_SECTOR)
+          batch_release (&batch, disk_inode->direct[i], 1);
+      if ((int) disk_inode->s_indirect != -1)
+        indirect_release (&batch, disk_inode->s_indirect);
+      if ((int) disk_inode->d_indirect != -1)
+        {
+          block_sector_t leaves[128];
+
+          cache_read (fs_device, disk_inode->d_indirect, leaves,
+                      BLOCK_SECTOR_SIZE, 0);
+          for (i = 0; i < 128; i++)
+            if ((int) leaves[i] != -1)
+              indirect_release (&batch, leaves[i]);
+          batch_release (&batch, disk_inode->d_indirect, 1);
         }
-      if ( (int) disk_inode->d_indirect == -1) {
-        free_map_allocate (&disk_inode->d_indirect, &index);
-      }
-      cache_write (fs_device, disk_inode->d_indirect, d_indirect, BLOCK_SECTOR_SIZE, 0);
-      free (d_indirect);
     }
+  batch_flush (&batch);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -225,13 +674,28 @@ inode_create (block_sector_t sector, off_t length, bool dir)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      disk_inode->s_indirect = -1;
-      disk_inode->d_indirect = -1;
+      disk_inode->format = new_format;
       disk_inode->dir = dir;
-      inode_allocate (disk_inode, 0, sectors);
-      // disk_inode write
-      cache_write (fs_device, sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
-      success = true;
+
+      /* Small files start out inline, with no sectors at all. */
+      if (!dir && length <= INLINE_MAX)
+        {
+          disk_inode->format = INODE_INLINE;
+          sectors = 0;
+        }
+      else if (new_format == INODE_INDEXED)
+        {
+          disk_inode->s_indirect = -1;
+          disk_inode->d_indirect = -1;
+        }
+      if (inode_allocate (disk_inode, 0, sectors, 0, 0, sector))
+        {
+          // disk_inode write
+          journal_write (sector, disk_inode, BLOCK_SECTOR_SIZE, 0);
+          success = true;
+        }
+      else
+        inode_deallocate (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -243,35 +707,57 @@ inode_create (block_sector_t sector, off_t length, bool dir)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already in memory. */
+  lock_acquire (&inode_table_lock);
+  key.sector = sector;
+  e = hash_find (&inode_table, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, hash_elem);
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->elem);
+          closed_cnt--;
         }
+      while (inode->loading)
+        cond_wait (&inode_loaded, &inode_table_lock);
+      lock_release (&inode_table_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inode_table_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  lock_init (&inode->inode_lock);
-  list_push_front (&open_inodes, &inode->elem);
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->dir_lock);
+  lock_init (&inode->leaf_lock);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  // block_read (fs_device, inode->sector, &inode->data);
+  inode->loading = true;
+  inode->ra_next = 0;
+  inode->ra_end = 0;
+  inode->leaf_idx = SIZE_MAX;
+  hash_insert (&inode_table, &inode->hash_elem);
+  lock_release (&inode_table_lock);
+
   cache_read (fs_device, inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+
+  lock_acquire (&inode_table_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &inode_table_lock);
+  lock_release (&inode_table_lock);
   return inode;
 }
 
@@ -280,7 +766,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -298,33 +788,51 @@ inode_get_removed (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it among the
+   recently closed inodes, freeing the least recently closed one
+   if there are too many.
+   If INODE was also a removed inode, frees it and its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  bool release = false;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&inode_table_lock);
   if (--inode->open_cnt == 0)
     {
-      lock_acquire (&inode->inode_lock);
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, once out of the table. */
       if (inode->removed) 
         {
-          free_map_release (inode->sector, 1);
-          // PANIC ("free_map_release todo\n");
-          // Todo
-          // free_map_release (inode->data.start,
-          //                   bytes_to_sectors (inode->data.length)); 
+          hash_delete (&inode_table, &inode->hash_elem);
+          release = true;
         }
-      lock_release (&inode->inode_lock);
-      free (inode); 
+      else
+        {
+          list_push_back (&closed_inodes, &inode->elem);
+          if (++closed_cnt > CLOSED_INODE_MAX)
+            {
+              struct inode *victim = list_entry (list_pop_front (&closed_inodes),
+                                                 struct inode, elem);
+              hash_delete (&inode_table, &victim->hash_elem);
+              closed_cnt--;
+              free (victim);
+            }
+        }
+    }
+  lock_release (&inode_table_lock);
+
+  /* The sectors stay allocated until here, so a new inode cannot
+     be created at INODE's sector before it has left the table. */
+  if (release)
+    {
+      inode_deallocate (&inode->data);
+      free_map_release (inode->sector, 1);
+      free (inode);
     }
 }
 
@@ -334,7 +842,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  rwlock_acquire_write (&inode->rwlock);
   inode->removed = true;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -345,11 +855,31 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
+  block_sector_t sector_idx = -1;
+  size_t run = 0;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->data.format == INODE_INLINE)
+    {
+      if (offset < inode_length (inode))
+        {
+          bytes_read = inode_length (inode) - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      rwlock_release_read (&inode->rwlock);
+      return bytes_read;
+    }
 
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = new_byte_to_sector (inode, offset);
+      /* Disk sector to read, starting byte offset within sector.
+         Consecutive sectors of a run need no further lookups. */
+      if (run == 0)
+        sector_idx = byte_to_sector (inode, offset, &run);
+      else if (sector_idx != HOLE_SECTOR)
+        sector_idx++;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -362,7 +892,11 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      cache_read (fs_device, sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
+      if (sector_idx == HOLE_SECTOR)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+        cache_read (fs_device, sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
+      run -= sector_ofs + chunk_size == BLOCK_SECTOR_SIZE;
       
       /* Advance. */
       size -= chunk_size;
@@ -370,47 +904,158 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
 
+  if (bytes_read > 0)
+    inode_read_ahead (inode, offset - bytes_read, offset);
+  rwlock_release_read (&inode->rwlock);
   return bytes_read;
 }
 
+/* Notes that bytes START through END (exclusive) of INODE were
+   just read.  If the read continued where the previous one left
+   off, queues the next READ_AHEAD_SECTORS sectors that have not
+   been queued already.  Concurrent readers update the read-ahead
+   window without locking; a lost update only skews one read-ahead
+   decision. */
+static void
+inode_read_ahead (struct inode *inode, off_t start, off_t end)
+{
+  size_t first = start / BLOCK_SECTOR_SIZE;
+  size_t next = DIV_ROUND_UP (end, BLOCK_SECTOR_SIZE);
+  size_t limit = bytes_to_sectors (inode_length (inode));
+  bool sequential = first == inode->ra_next || first + 1 == inode->ra_next;
+  size_t i;
+
+  inode->ra_next = next;
+  if (!sequential)
+    {
+      inode->ra_end = next;
+      return;
+    }
+
+  if (inode->ra_end < next)
+    inode->ra_end = next;
+  for (i = inode->ra_end; i < next + READ_AHEAD_SECTORS && i < limit; i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE, NULL);
+      if (sector != HOLE_SECTOR)
+        cache_readahead (sector);
+    }
+  inode->ra_end = i;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends the file, leaving any gap
+   before OFFSET as a hole.  Sectors are allocated only for holes
+   that the write lands in. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-
-  if (inode->deny_write_cnt > 0)
-    return 0;
+  off_t old_len;
+  bool exclusive;
+  bool map_changed = false;
+  bool meta;
+  block_sector_t sector_idx = -1;
+  size_t run = 0;
 
   if (size <= 0)
     return 0;
 
-  if ((int)new_byte_to_sector (inode, offset + size - 1) == -1) {
-    // PANIC ("file growth needed\n");
-    off_t old_len = inode->data.length;
-    off_t new_len = offset + size;
-    size_t start_sector = bytes_to_sectors (old_len);
-    size_t end_sector = bytes_to_sectors (new_len);
-    if (start_sector < end_sector) {
-      inode_allocate (&inode->data, start_sector, end_sector - start_sector);
+  /* The contents of directories and of the free map are metadata,
+     and go through the journal like the inode itself. */
+  meta = inode->data.dir || inode->sector == FREE_MAP_SECTOR;
+  journal_begin ();
+
+  /* Files only grow, so a write that fits now will still fit
+     once the lock is held.  Inline data lives in DATA itself.
+     Inodes never go back to being inline, so one that is not
+     inline now will not be once the lock is held either. */
+  exclusive = (offset + size > inode_length (inode)
+               || inode->data.format == INODE_INLINE);
+  if (exclusive)
+    rwlock_acquire_write (&inode->rwlock);
+  else
+    rwlock_acquire_read (&inode->rwlock);
+
+  if (inode->deny_write_cnt > 0)
+    {
+      if (exclusive)
+        rwlock_release_write (&inode->rwlock);
+      else
+        rwlock_release_read (&inode->rwlock);
+      journal_end ();
+      return 0;
     }
 
-    inode->data.length = new_len;
-    cache_write (fs_device, inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
-  }
+  /* A write that keeps an inline file small enough goes into the
+     inode sector.  One that does not moves the file's bytes out to
+     a data sector first. */
+  if (inode->data.format == INODE_INLINE)
+    {
+      if (offset + size <= INLINE_MAX)
+        {
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          journal_write (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+          rwlock_release_write (&inode->rwlock);
+          journal_end ();
+          return size;
+        }
+      if (!inode_uninline (inode))
+        {
+          rwlock_release_write (&inode->rwlock);
+          journal_end ();
+          return 0;
+        }
+      map_changed = true;
+    }
+
+  old_len = inode->data.length;
+  if (offset + size > old_len)
+    inode->data.length = offset + size;
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = new_byte_to_sector (inode, offset);
+      /* Sector to write, starting byte offset within sector.
+         Consecutive sectors of a run need no further lookups. */
+      if (run > 0)
+        sector_idx++;
+      else
+        sector_idx = byte_to_sector (inode, offset, &run);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
+      /* Filling a hole changes the map, so it needs the lock
+         exclusively. */
+      if (sector_idx == HOLE_SECTOR && !exclusive)
+        {
+          rwlock_release_read (&inode->rwlock);
+          rwlock_acquire_write (&inode->rwlock);
+          exclusive = true;
+          sector_idx = byte_to_sector (inode, offset, &run);
+        }
+
+      /* Allocate the holes in the rest of the write at once.
+         Sectors the write covers in full need no zeroing. */
+      if (sector_idx == HOLE_SECTOR)
+        {
+          size_t first = offset / BLOCK_SECTOR_SIZE;
+          size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+          bool success = inode_allocate (&inode->data, first, last - first + 1,
+                                         DIV_ROUND_UP (offset, BLOCK_SECTOR_SIZE),
+                                         (offset + size) / BLOCK_SECTOR_SIZE,
+                                         inode->sector);
+          map_changed = true;
+          inode->leaf_idx = SIZE_MAX;
+          sector_idx = byte_to_sector (inode, offset, &run);
+          if (!success && sector_idx == HOLE_SECTOR)
+            break;
+        }
+
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
@@ -421,7 +1066,12 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      cache_write (fs_device, sector_idx, (void *) buffer + bytes_written, chunk_size, sector_ofs);
+      if (meta)
+        journal_write (sector_idx, (void *) buffer + bytes_written, chunk_size, sector_ofs);
+      else
+        cache_write_owned (fs_device, sector_idx, (void *) buffer + bytes_written,
+                           chunk_size, sector_ofs, inode->sector);
+      run -= sector_ofs + chunk_size == BLOCK_SECTOR_SIZE;
 
       /* Advance. */
       size -= chunk_size;
@@ -429,16 +1079,84 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
 
+  /* If the disk filled up, end the file after what was written. */
+  if (inode->data.length > old_len && offset < inode->data.length)
+    inode->data.length = offset > old_len ? offset : old_len;
+  if (map_changed || inode->data.length != old_len)
+    journal_write (inode->sector, &inode->data, BLOCK_SECTOR_SIZE, 0);
+
+  if (exclusive)
+    rwlock_release_write (&inode->rwlock);
+  else
+    rwlock_release_read (&inode->rwlock);
+  journal_end ();
   return bytes_written;
 }
 
+/* Moves the bytes of INODE, which must be inline, out to a data
+   sector, and gives it the map of the format new inodes get.
+   The caller must hold INODE's lock exclusively, and write the
+   inode sector afterward.  Returns false, leaving INODE inline,
+   if memory or disk allocation fails. */
+static bool
+inode_uninline (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t sectors = bytes_to_sectors (disk_inode->length);
+  uint8_t *bounce;
+
+  bounce = calloc (1, BLOCK_SECTOR_SIZE);
+  if (bounce == NULL)
+    return false;
+  memcpy (bounce, disk_inode->inline_data, disk_inode->length);
+
+  memset (disk_inode->inline_data, 0, INLINE_MAX);
+  disk_inode->format = new_format;
+  if (new_format == INODE_INDEXED)
+    {
+      disk_inode->s_indirect = -1;
+      disk_inode->d_indirect = -1;
+    }
+
+  /* The bounce buffer covers the whole sector, so it needs no
+     zeroing. */
+  if (!inode_allocate (disk_inode, 0, sectors, 0, sectors, inode->sector))
+    {
+      inode_deallocate (disk_inode);
+      memset (disk_inode->inline_data, 0, INLINE_MAX);
+      memcpy (disk_inode->inline_data, bounce, disk_inode->length);
+      disk_inode->format = INODE_INLINE;
+      free (bounce);
+      return false;
+    }
+  inode->leaf_idx = SIZE_MAX;
+  if (sectors > 0)
+    cache_write_owned (fs_device, byte_to_sector (inode, 0, NULL), bounce,
+                       BLOCK_SECTOR_SIZE, 0, inode->sector);
+  free (bounce);
+  return true;
+}
+
+/* Writes INODE's dirty file data to disk in ascending sector
+   order, then commits the journal, which carries its metadata.
+   Without a journal, the whole cache is written back instead. */
+void
+inode_sync (struct inode *inode)
+{
+  cache_flush_owner (fs_device, inode->sector);
+  if (!journal_commit ())
+    cache_flush (fs_device);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -448,8 +1166,10 @@ void
 inode_allow_write (struct inode *inode) 
 {
   // ASSERT (inode->deny_write_cnt > 0);
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -459,9 +1179,39 @@ inode_length (const struct inode *inode)
   return inode->data.length;
 }
 
+/* Acquires the directory lock of INODE, which must be a
+   directory, so that a lookup and the update that depends on it
+   happen atomically with respect to other directory operations. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
+
 /* Returns if inode disk is direcotry or not*/
 bool
 inode_dir (const struct inode *inode)
 {
   return inode->data.dir;
 }
+
+/* Returns the format of INODE's data map. */
+enum inode_format
+inode_get_format (const struct inode *inode)
+{
+  return inode->data.format;
+}
+
+/* Sets the format given to inodes created from now on. */
+void
+inode_set_format (enum inode_format format)
+{
+  new_format = format;
+}
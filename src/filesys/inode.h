@@ -8,6 +8,14 @@
 
 struct bitmap;
 
+/* How an inode maps its data sectors. */
+enum inode_format
+  {
+    INODE_INDEXED,              /* Direct and indirect pointers. */
+    INODE_EXTENTS,              /* Runs of consecutive sectors. */
+    INODE_INLINE                /* Data kept in the inode itself. */
+  };
+
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
@@ -20,6 +28,11 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_sync (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_dir (const struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
+enum inode_format inode_get_format (const struct inode *);
+void inode_set_format (enum inode_format);
 #endif /* filesys/inode.h */
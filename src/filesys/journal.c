@@ -0,0 +1,411 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Every operation that changes file system metadata runs between
+   journal_begin() and journal_end().  Metadata sectors it writes
+   (inodes, indirect blocks, directory contents and the free map)
+   join the running transaction: they stay in the buffer cache and
+   are not written back in place.  Once no operation is running,
+   the transaction commits.  The images of its sectors are written
+   one after another to the log region, and then the header, which
+   lists their home sectors, is written.  After the header has
+   reached the disk, the sectors are ordinary dirty cache entries
+   again.
+
+   If the system stops before the next commit, journal_init()
+   copies the logged images to their home sectors again, so the
+   metadata on disk always reflects a whole number of committed
+   transactions.  Before the log region is reused, the previous
+   transaction is checkpointed: its sectors are written home and
+   the header is cleared.
+
+   File data is not journaled. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* Most sectors one transaction may log. */
+#define JOURNAL_MAX (JOURNAL_SECTORS - 1)
+
+/* Journal header, stored at JOURNAL_SECTOR.  Slot I of the log,
+   at JOURNAL_SECTOR + 1 + I, holds the image of SECTORS[I]. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Commits made so far. */
+    uint32_t cnt;                       /* Logged sectors, 0 if none. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home sectors of the slots. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12 - 4 * JOURNAL_MAX];
+  };
+
+static bool enabled;                    /* Journaling? */
+static struct journal_header header;    /* Copy of the on-disk header. */
+
+/* The running transaction.  JOURNAL_LOCK guards all of these.
+   A commit holds it throughout, which keeps new operations from
+   starting until the commit is done, and while a commit waits for
+   the running operations to end, new ones wait for the commit.
+   Outside of commits and checkpoints, the lock is not held
+   across disk I/O. */
+static struct lock journal_lock;
+static struct condition quiescent;      /* Signaled when ACTIVE drops to 0. */
+static struct condition committed;      /* Signaled when COMMITTERS drops
+                                           to 0. */
+static int active;                      /* Operations running. */
+static int committers;                  /* Commits waiting for ACTIVE to
+                                           drop to 0. */
+static block_sector_t tx_sectors[JOURNAL_MAX]; /* Sectors joined. */
+static size_t tx_cnt;                   /* Number of TX_SECTORS. */
+static size_t tx_reserved;              /* Slots held for sectors being
+                                           written into the cache. */
+static size_t tx_max;                   /* Limit on TX_CNT. */
+static bool overflowed;                 /* Did sectors not fit? */
+
+static void replay (void);
+static void write_header (void);
+static void checkpoint (void);
+static void wait_quiescent (void);
+static void begin_overflow (void);
+static bool commit_locked (void);
+static void journal_committer (void *aux);
+
+/* Initializes the journal.  If FORMAT is true, writes an empty
+   journal; otherwise, replays the last committed transaction.
+   Must be called before anything else reads the file system. */
+void
+journal_init (bool format)
+{
+  lock_init (&journal_lock);
+  cond_init (&quiescent);
+  cond_init (&committed);
+
+  /* Keep a quarter of the cache free of journaled entries. */
+  tx_max = cache_size () / 4;
+  if (tx_max > JOURNAL_MAX)
+    tx_max = JOURNAL_MAX;
+
+  if (format)
+    {
+      memset (&header, 0, sizeof header);
+      header.magic = JOURNAL_MAGIC;
+      write_header ();
+    }
+  else
+    {
+      block_read (fs_device, JOURNAL_SECTOR, &header);
+      if (header.magic != JOURNAL_MAGIC || header.cnt > JOURNAL_MAX)
+        {
+          printf ("filesys: no journal found, journaling disabled\n");
+          return;
+        }
+      replay ();
+    }
+  enabled = true;
+
+  if (cache_flush_ms > 0)
+    thread_create ("journal", PRI_DEFAULT, journal_committer, NULL);
+}
+
+/* Commits the running transaction, writes its sectors home, and
+   stops journaling. */
+void
+journal_done (void)
+{
+  if (!enabled)
+    return;
+  lock_acquire (&journal_lock);
+  wait_quiescent ();
+  commit_locked ();
+  if (header.cnt > 0)
+    checkpoint ();
+  enabled = false;
+  lock_release (&journal_lock);
+}
+
+/* Starts an operation that changes metadata.  Waits if a commit
+   is in progress or waiting to start.  Operations may nest; only
+   the outermost one counts. */
+void
+journal_begin (void)
+{
+  if (!enabled || lock_held_by_current_thread (&journal_lock))
+    return;
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  while (committers > 0)
+    cond_wait (&committed, &journal_lock);
+  active++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started with journal_begin().  The last
+   operation to end commits the transaction if it has grown to half
+   of its limit or outgrown it.  The caller must not hold any file
+   system lock. */
+void
+journal_end (void)
+{
+  if (!enabled || lock_held_by_current_thread (&journal_lock))
+    return;
+  ASSERT (thread_current ()->journal_depth > 0);
+  if (--thread_current ()->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  ASSERT (active > 0);
+  if (--active == 0)
+    {
+      cond_broadcast (&quiescent, &journal_lock);
+      if (tx_cnt >= tx_max / 2 || overflowed)
+        commit_locked ();
+    }
+  lock_release (&journal_lock);
+}
+
+/* Writes SIZE bytes from BUFFER into metadata SECTOR at OFFSET,
+   as cache_write() does, adding SECTOR to the running
+   transaction.  If the transaction is full, the write bypasses
+   the journal, and the transaction will not be atomic.
+
+   The journal lock is only held to decide how to write SECTOR and
+   to record it afterward, not while the cache reads it in or
+   writes back a victim to make room for it.  Meanwhile a slot of
+   the transaction is reserved for SECTOR, and the write counts as
+   a running operation, so that no commit can come between. */
+void
+journal_write (block_sector_t sector, void *buffer, int size, int offset)
+{
+  bool journaled = true;
+  bool reserved = false;
+
+  if (!enabled)
+    {
+      cache_write (fs_device, sector, buffer, size, offset);
+      return;
+    }
+
+  /* The free map joins the transaction its committer is
+     committing, which may use the whole log for it. */
+  if (lock_held_by_current_thread (&journal_lock))
+    {
+      if (tx_cnt < JOURNAL_MAX || cache_journaled (sector))
+        {
+          if (cache_write_journaled (fs_device, sector, buffer, size, offset))
+            tx_sectors[tx_cnt++] = sector;
+        }
+      else
+        {
+          begin_overflow ();
+          cache_write (fs_device, sector, buffer, size, offset);
+        }
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  if (active == 0)
+    journaled = false;
+  else if (tx_cnt + tx_reserved < tx_max)
+    reserved = true;
+  else if (!cache_journaled (sector))
+    {
+      begin_overflow ();
+      journaled = false;
+    }
+  if (!journaled)
+    {
+      lock_release (&journal_lock);
+      cache_write (fs_device, sector, buffer, size, offset);
+      return;
+    }
+  if (reserved)
+    tx_reserved++;
+  active++;
+  lock_release (&journal_lock);
+
+  journaled = cache_write_journaled (fs_device, sector, buffer, size, offset);
+
+  lock_acquire (&journal_lock);
+  if (journaled)
+    tx_sectors[tx_cnt++] = sector;
+  if (reserved)
+    tx_reserved--;
+  if (--active == 0)
+    cond_broadcast (&quiescent, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Waits until no operation is running and commits the running
+   transaction.  Returns true once it is on disk.  Returns false
+   if journaling is disabled, or if the transaction overflowed, so
+   that metadata written around the journal is still only in the
+   cache: the caller must then flush the cache to make it
+   durable. */
+bool
+journal_commit (void)
+{
+  bool durable;
+
+  if (!enabled)
+    return false;
+  lock_acquire (&journal_lock);
+  wait_quiescent ();
+  durable = commit_locked ();
+  lock_release (&journal_lock);
+  return durable;
+}
+
+/* Waits until no operation is running, keeping new operations
+   from starting meanwhile.  The caller must hold JOURNAL_LOCK. */
+static void
+wait_quiescent (void)
+{
+  committers++;
+  while (active > 0)
+    cond_wait (&quiescent, &journal_lock);
+  if (--committers == 0)
+    cond_broadcast (&committed, &journal_lock);
+}
+
+/* Lets metadata writes bypass the running transaction, which has
+   no room left for them.  Sectors written in place from now on
+   must not be overwritten by replaying an older transaction, so
+   that is checkpointed first.  The caller must hold
+   JOURNAL_LOCK. */
+static void
+begin_overflow (void)
+{
+  if (!overflowed && header.cnt > 0)
+    checkpoint ();
+  overflowed = true;
+}
+
+/* Commits the running transaction.  The caller must hold
+   JOURNAL_LOCK, with no operation running.  Returns false if the
+   transaction overflowed, in which case its sectors are written
+   home instead, but the writes that bypassed the journal are
+   not. */
+static bool
+commit_locked (void)
+{
+  static uint8_t image[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (active == 0);
+
+  /* Free map changes belong to the operations being committed. */
+  free_map_flush ();
+
+  if (overflowed)
+    {
+      /* The header was cleared when the overflow began. */
+      for (i = 0; i < tx_cnt; i++)
+        {
+          cache_unjournal (tx_sectors[i]);
+          cache_write_sector (fs_device, tx_sectors[i]);
+        }
+      tx_cnt = 0;
+      overflowed = false;
+      return false;
+    }
+  if (tx_cnt == 0)
+    return true;
+
+  if (header.cnt > 0)
+    checkpoint ();
+  for (i = 0; i < tx_cnt; i++)
+    {
+      cache_read (fs_device, tx_sectors[i], image, BLOCK_SECTOR_SIZE, 0);
+      block_write (fs_device, JOURNAL_SECTOR + 1 + i, image);
+    }
+
+  /* Commit point. */
+  header.seq++;
+  header.cnt = tx_cnt;
+  memcpy (header.sectors, tx_sectors, tx_cnt * sizeof *tx_sectors);
+  write_header ();
+
+  for (i = 0; i < tx_cnt; i++)
+    cache_unjournal (tx_sectors[i]);
+  tx_cnt = 0;
+  return true;
+}
+
+/* Writes the sectors of the committed transaction home and clears
+   the header, so the log region can be reused.  A sector that has
+   since joined the running transaction is written from its logged
+   image, since its cached copy holds uncommitted changes.  The
+   caller must hold JOURNAL_LOCK. */
+static void
+checkpoint (void)
+{
+  static uint8_t image[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  for (i = 0; i < header.cnt; i++)
+    {
+      block_sector_t sector = header.sectors[i];
+      if (cache_journaled (sector))
+        {
+          block_read (fs_device, JOURNAL_SECTOR + 1 + i, image);
+          block_write (fs_device, sector, image);
+        }
+      else
+        cache_write_sector (fs_device, sector);
+    }
+  header.cnt = 0;
+  write_header ();
+}
+
+/* Copies the images of the committed transaction to their home
+   sectors and clears the header.  Bypasses the buffer cache,
+   which must not hold any of those sectors yet. */
+static void
+replay (void)
+{
+  static uint8_t image[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  if (header.cnt == 0)
+    return;
+  printf ("filesys: replaying %"PRIu32" journaled sectors\n", header.cnt);
+  for (i = 0; i < header.cnt; i++)
+    {
+      block_read (fs_device, JOURNAL_SECTOR + 1 + i, image);
+      block_write (fs_device, header.sectors[i], image);
+    }
+  header.cnt = 0;
+  write_header ();
+}
+
+/* Writes HEADER to JOURNAL_SECTOR. */
+static void
+write_header (void)
+{
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Journal commit thread.  Commits the running transaction every
+   cache_flush_ms milliseconds, so that metadata reaches the disk
+   about as soon as the write-behind thread would have written
+   it. */
+static void
+journal_committer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (cache_flush_ms);
+      journal_commit ();
+    }
+}
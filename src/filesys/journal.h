@@ -0,0 +1,18 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Sectors reserved for the journal, starting at JOURNAL_SECTOR:
+   a header followed by one slot per logged sector. */
+#define JOURNAL_SECTORS 64
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_write (block_sector_t, void *buffer, int size, int offset);
+bool journal_commit (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_CACHE_STATS_H
+#define __LIB_CACHE_STATS_H
+
+/* Buffer cache statistics, as reported by the cachestat system
+   call.  Every count is cumulative since boot. */
+struct cache_stats
+  {
+    unsigned long long hits;            /* Lookups found in the cache. */
+    unsigned long long misses;          /* Lookups that had to load. */
+    unsigned long long read_skips;      /* Misses overwritten whole, unread. */
+    unsigned long long evictions;       /* Valid entries replaced. */
+    unsigned long long writebacks;      /* Dirty sectors written to disk. */
+    unsigned long long readaheads;      /* Sectors read ahead. */
+    unsigned long long readahead_used;  /* ...later looked up. */
+    unsigned long long readahead_wasted; /* ...evicted unused. */
+  };
+
+#endif /* lib/cache-stats.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum length of a name in a `struct dirent'.  Matches the
+   file system's NAME_MAX and readdir()'s READDIR_MAX_LEN. */
+#define DIRENT_NAME_MAX 14
+
+/* Directory entry, as reported by the getdents system call. */
+struct dirent
+  {
+    int inumber;                        /* Inode number of the entry. */
+    bool is_dir;                        /* Is the entry a directory? */
+    char name[DIRENT_NAME_MAX + 1];     /* Null terminated name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* File system extensions. */
+    SYS_CACHESTAT,              /* Reports buffer cache statistics. */
+    SYS_GETDENTS,               /* Reads several directory entries. */
+    SYS_FSYNC,                  /* Writes a file's changes to disk. */
+    SYS_SYNC                    /* Writes all changes to disk. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <cache-stats.h>
+#include <dirent.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* File system extensions. */
+bool cachestat (struct cache_stats *);
+int getdents (int fd, struct dirent *, unsigned cnt);
+bool fsync (int fd);
+void sync (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,29 @@
+/* Reads a file twice and checks, with cachestat(), that the
+   second read is served from the buffer cache. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  struct cache_stats before, after;
+  int fd;
+
+  CHECK (create ("cachy", sizeof buf), "create \"cachy\"");
+  CHECK ((fd = open ("cachy")) > 1, "open \"cachy\"");
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf, "read \"cachy\"");
+  CHECK (cachestat (&before), "cachestat");
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read \"cachy\" again");
+  CHECK (cachestat (&after), "cachestat");
+  if (after.hits - before.hits < sizeof buf / 512)
+    fail ("second read hit the cache only %llu times",
+          after.hits - before.hits);
+  msg ("close \"cachy\"");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-stats) begin
+(cache-stats) create "cachy"
+(cache-stats) open "cachy"
+(cache-stats) read "cachy"
+(cache-stats) cachestat
+(cache-stats) read "cachy" again
+(cache-stats) cachestat
+(cache-stats) close "cachy"
+(cache-stats) end
+EOF
+pass;
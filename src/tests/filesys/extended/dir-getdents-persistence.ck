@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my (%g);
+$g{"f$_"} = [''] foreach 0...19;
+$g{"d$_"} = {} foreach 20...24;
+check_archive ({"g" => {%g}});
+pass;
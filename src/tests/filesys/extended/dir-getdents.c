@@ -0,0 +1,76 @@
+/* Creates a directory holding files and subdirectories, then
+   lists it with getdents() a few entries at a time and checks
+   each entry's name, type and inode number. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20
+#define DIR_CNT 5
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 8];
+  struct dirent ents[3];
+  int seen[FILE_CNT + DIR_CNT];
+  int fd, dir_fd, cnt, total, i;
+
+  CHECK (mkdir ("/g"), "mkdir \"/g\"");
+  msg ("creating %d files and %d directories", FILE_CNT, DIR_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT + DIR_CNT; i++)
+    {
+      seen[i] = 0;
+      if (i < FILE_CNT)
+        {
+          snprintf (name, sizeof name, "/g/f%d", i);
+          CHECK (create (name, 0), "create \"%s\"", name);
+        }
+      else
+        {
+          snprintf (name, sizeof name, "/g/d%d", i);
+          CHECK (mkdir (name), "mkdir \"%s\"", name);
+        }
+    }
+  quiet = false;
+
+  CHECK ((dir_fd = open ("/g")) > 1, "open \"/g\"");
+  total = 0;
+  quiet = true;
+  while ((cnt = getdents (dir_fd, ents, 3)) > 0)
+    for (i = 0; i < cnt; i++)
+      {
+        struct dirent *e = &ents[i];
+        bool is_dir = e->name[0] == 'd';
+        int idx = atoi (e->name + 1);
+
+        if ((e->name[0] != 'f' && e->name[0] != 'd')
+            || idx < 0 || idx >= FILE_CNT + DIR_CNT
+            || is_dir != (idx >= FILE_CNT) || seen[idx]++)
+          fail ("getdents returned unexpected name \"%s\"", e->name);
+        if (e->is_dir != is_dir)
+          fail ("getdents returned wrong type for \"%s\"", e->name);
+
+        snprintf (name, sizeof name, "/g/%s", e->name);
+        CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+        if (inumber (fd) != e->inumber)
+          fail ("getdents returned wrong inumber for \"%s\"", e->name);
+        close (fd);
+        total++;
+      }
+  quiet = false;
+  if (cnt < 0)
+    fail ("getdents failed");
+  if (total != FILE_CNT + DIR_CNT)
+    fail ("getdents returned %d entries, expected %d",
+          total, FILE_CNT + DIR_CNT);
+  msg ("getdents returned %d entries", total);
+  CHECK (getdents (dir_fd, ents, 3) == 0, "getdents at end returns 0");
+  msg ("close \"/g\"");
+  close (dir_fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "/g"
+(dir-getdents) creating 20 files and 5 directories
+(dir-getdents) open "/g"
+(dir-getdents) getdents returned 25 entries
+(dir-getdents) getdents at end returns 0
+(dir-getdents) close "/g"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my (%h);
+$h{"file$_"} = [''] foreach grep ($_ % 2, 0...299);
+check_archive ({"h" => {%h}});
+pass;
@@ -0,0 +1,61 @@
+/* Creates enough files in one directory for it to switch to
+   hashed lookup, then opens them all, removes half of them, and
+   checks that readdir sees exactly the other half. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 300
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 8];
+  int fd, i, cnt;
+
+  CHECK (mkdir ("/h"), "mkdir \"/h\"");
+
+  msg ("creating %d files", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "/h/file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening %d files", FILE_CNT);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "/h/file%d", i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  msg ("removing even-numbered files");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "/h/file%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  CHECK ((fd = open ("/h")) > 1, "open \"/h\"");
+  for (cnt = 0; readdir (fd, name); cnt++)
+    {
+      if (memcmp (name, "file", 4) || atoi (name + 4) % 2 == 0)
+        fail ("readdir returned unexpected name \"%s\"", name);
+    }
+  if (cnt != FILE_CNT / 2)
+    fail ("readdir returned %d names, expected %d", cnt, FILE_CNT / 2);
+  msg ("readdir returned %d names", cnt);
+  msg ("close \"/h\"");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-hash) begin
+(dir-hash) mkdir "/h"
+(dir-hash) creating 300 files
+(dir-hash) opening 300 files
+(dir-hash) removing even-numbered files
+(dir-hash) open "/h"
+(dir-hash) readdir returned 150 names
+(dir-hash) close "/h"
+(dir-hash) end
+EOF
+pass;
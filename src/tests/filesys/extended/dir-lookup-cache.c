@@ -0,0 +1,39 @@
+/* Looks up the same names over and over while they are created,
+   removed and recreated, checking that lookups always reflect
+   the current state of the directory tree. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd, i;
+
+  CHECK (mkdir ("/d"), "mkdir \"/d\"");
+  CHECK (open ("/d/f") == -1, "open \"/d/f\" (must fail)");
+  CHECK (open ("/d/f") == -1, "open \"/d/f\" again (must fail)");
+  CHECK (create ("/d/f", 0), "create \"/d/f\"");
+  CHECK ((fd = open ("/d/f")) > 1, "open \"/d/f\"");
+  close (fd);
+  CHECK (remove ("/d/f"), "remove \"/d/f\"");
+  CHECK (open ("/d/f") == -1, "open \"/d/f\" (must fail)");
+
+  msg ("recreating \"/d/e/f\" 10 times");
+  quiet = true;
+  for (i = 0; i < 10; i++)
+    {
+      CHECK (mkdir ("/d/e"), "mkdir \"/d/e\"");
+      CHECK (open ("/d/e/f") == -1, "open \"/d/e/f\" (must fail)");
+      CHECK (create ("/d/e/f", 0), "create \"/d/e/f\"");
+      CHECK ((fd = open ("/d/e/f")) > 1, "open \"/d/e/f\"");
+      close (fd);
+      CHECK (remove ("/d/e/f"), "remove \"/d/e/f\"");
+      CHECK (remove ("/d/e"), "remove \"/d/e\"");
+      CHECK (open ("/d/e") == -1, "open \"/d/e\" (must fail)");
+    }
+  quiet = false;
+
+  CHECK (create ("/d/g", 0), "create \"/d/g\"");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-lookup-cache) begin
+(dir-lookup-cache) mkdir "/d"
+(dir-lookup-cache) open "/d/f" (must fail)
+(dir-lookup-cache) open "/d/f" again (must fail)
+(dir-lookup-cache) create "/d/f"
+(dir-lookup-cache) open "/d/f"
+(dir-lookup-cache) remove "/d/f"
+(dir-lookup-cache) open "/d/f" (must fail)
+(dir-lookup-cache) recreating "/d/e/f" 10 times
+(dir-lookup-cache) create "/d/g"
+(dir-lookup-cache) end
+EOF
+pass;
@@ -0,0 +1,90 @@
+/* Adds files to a hashed directory on a nearly full disk until
+   creating one fails, which makes a bucket split run out of
+   space, and checks that every file created before that can
+   still be opened. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Files created up front, enough to make the directory hashed. */
+#define FIRST_CNT 80
+
+/* Sector-sized files whose space is freed once the disk is full,
+   fewer sectors than a bucket split needs. */
+#define SPARE_CNT 4
+
+static char block[512];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (chdir ("d"), "chdir \"d\"");
+
+  msg ("creating %d files", FIRST_CNT);
+  quiet = true;
+  for (i = 0; i < FIRST_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  for (i = 0; i < SPARE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "s%d", i);
+      CHECK (create (name, sizeof block), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("filling the disk");
+  quiet = true;
+  CHECK (create ("fill", 0), "create \"fill\"");
+  CHECK ((fd = open ("fill")) > 1, "open \"fill\"");
+  while (write (fd, block, sizeof block) == sizeof block)
+    continue;
+  close (fd);
+  quiet = false;
+
+  msg ("freeing spare sectors");
+  quiet = true;
+  for (i = 0; i < SPARE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "s%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("creating files until the disk is full");
+  for (cnt = FIRST_CNT; ; cnt++)
+    {
+      snprintf (name, sizeof name, "f%d", cnt);
+      if (!create (name, 0))
+        break;
+    }
+
+  msg ("opening every file created");
+  quiet = true;
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  msg ("removing everything");
+  quiet = true;
+  for (i = 0; i < cnt; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  CHECK (remove ("fill"), "remove \"fill\"");
+  CHECK (chdir (".."), "chdir \"..\"");
+  CHECK (remove ("d"), "remove \"d\"");
+  quiet = false;
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-split-full) begin
+(dir-split-full) mkdir "d"
+(dir-split-full) chdir "d"
+(dir-split-full) creating 80 files
+(dir-split-full) filling the disk
+(dir-split-full) freeing spare sectors
+(dir-split-full) creating files until the disk is full
+(dir-split-full) opening every file created
+(dir-split-full) removing everything
+(dir-split-full) end
+EOF
+pass;
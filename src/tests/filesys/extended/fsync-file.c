@@ -0,0 +1,30 @@
+/* Writes a file in two parts, forcing each to disk with fsync(),
+   then forces everything else to disk with sync(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[2048];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf, 'f', sizeof buf);
+  CHECK (create ("fsync", 0), "create \"fsync\"");
+  CHECK ((fd = open ("fsync")) > 1, "open \"fsync\"");
+  CHECK (write (fd, buf, 1000) == 1000, "write 1000 bytes to \"fsync\"");
+  CHECK (fsync (fd), "fsync \"fsync\"");
+  CHECK (write (fd, buf + 1000, 1048) == 1048,
+         "write 1048 bytes to \"fsync\"");
+  CHECK (fsync (fd), "fsync \"fsync\"");
+  CHECK (!fsync (fd + 1), "fsync unopened fd (must fail)");
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  msg ("sync");
+  sync ();
+  msg ("close \"fsync\"");
+  close (fd);
+}
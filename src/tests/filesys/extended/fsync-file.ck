@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-file) begin
+(fsync-file) create "fsync"
+(fsync-file) open "fsync"
+(fsync-file) write 1000 bytes to "fsync"
+(fsync-file) fsync "fsync"
+(fsync-file) write 1048 bytes to "fsync"
+(fsync-file) fsync "fsync"
+(fsync-file) fsync unopened fd (must fail)
+(fsync-file) mkdir "d"
+(fsync-file) sync
+(fsync-file) close "fsync"
+(fsync-file) end
+EOF
+pass;
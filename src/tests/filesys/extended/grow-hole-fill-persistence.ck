@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["\0" x 20000 . "h" x 2048
+			       . "\0" x (65536 - 20000 - 2048 - 1) . "e"]});
+pass;
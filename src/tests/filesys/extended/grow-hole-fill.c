@@ -0,0 +1,34 @@
+/* Tests that writing into the hole left by seeking past the end
+   of a file stores the data there and leaves the rest of the
+   hole reading as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[65536];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  memset (buf + 20000, 'h', 2048);
+  buf[sizeof buf - 1] = 'e';
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("seek \"%s\" past end", file_name);
+  seek (fd, sizeof buf - 1);
+  CHECK (write (fd, buf + sizeof buf - 1, 1) == 1, "write \"%s\"", file_name);
+  msg ("seek \"%s\" into hole", file_name);
+  seek (fd, 20000);
+  CHECK (write (fd, buf + 20000, 2048) == 2048, "write \"%s\" into hole",
+         file_name);
+  CHECK (filesize (fd) == sizeof buf, "filesize \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-hole-fill) begin
+(grow-hole-fill) create "testfile"
+(grow-hole-fill) open "testfile"
+(grow-hole-fill) seek "testfile" past end
+(grow-hole-fill) write "testfile"
+(grow-hole-fill) seek "testfile" into hole
+(grow-hole-fill) write "testfile" into hole
+(grow-hole-fill) filesize "testfile"
+(grow-hole-fill) close "testfile"
+(grow-hole-fill) open "testfile" for verification
+(grow-hole-fill) verified contents of "testfile"
+(grow-hole-fill) close "testfile"
+(grow-hole-fill) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"inline" => ["\0" x 50 . 'a' x 400 . 'b' x 750]});
+pass;
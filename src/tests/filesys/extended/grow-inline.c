@@ -0,0 +1,28 @@
+/* Creates a file small enough to be kept inline in its inode,
+   writes into it, then grows it past the inline limit, checking
+   its contents at each step. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1200];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  memset (buf + 50, 'a', 400);
+  memset (buf + 450, 'b', 750);
+  CHECK (create ("inline", 100), "create \"inline\"");
+  CHECK ((fd = open ("inline")) > 1, "open \"inline\"");
+  seek (fd, 50);
+  CHECK (write (fd, buf + 50, 400) == 400, "write 400 bytes to \"inline\"");
+  check_file ("inline", buf, 450);
+  CHECK (write (fd, buf + 450, 750) == 750, "write 750 bytes to \"inline\"");
+  check_file ("inline", buf, sizeof buf);
+  msg ("close \"inline\"");
+  close (fd);
+}
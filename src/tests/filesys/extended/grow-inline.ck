@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-inline) begin
+(grow-inline) create "inline"
+(grow-inline) open "inline"
+(grow-inline) write 400 bytes to "inline"
+(grow-inline) open "inline" for verification
+(grow-inline) verified contents of "inline"
+(grow-inline) close "inline"
+(grow-inline) write 750 bytes to "inline"
+(grow-inline) open "inline" for verification
+(grow-inline) verified contents of "inline"
+(grow-inline) close "inline"
+(grow-inline) close "inline"
+(grow-inline) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Creates and removes a large file more times than the disk
+   could hold all of them, checking that removing a file returns
+   its sectors to the free map. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHURN_CNT 8
+
+static char buf[65536];
+
+void
+test_main (void) 
+{
+  const char *file_name = "churn";
+  int i, j;
+
+  for (i = 0; i < CHURN_CNT; i++)
+    {
+      int fd;
+
+      CHECK (create (file_name, 0), "create \"%s\" (round %d)", file_name, i);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      quiet = true;
+      for (j = 0; j < 8; j++)
+        CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+               "write \"%s\"", file_name);
+      quiet = false;
+      msg ("close \"%s\"", file_name);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+}
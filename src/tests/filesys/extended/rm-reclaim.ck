@@ -0,0 +1,41 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rm-reclaim) begin
+(rm-reclaim) create "churn" (round 0)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 1)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 2)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 3)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 4)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 5)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 6)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) create "churn" (round 7)
+(rm-reclaim) open "churn"
+(rm-reclaim) close "churn"
+(rm-reclaim) remove "churn"
+(rm-reclaim) end
+EOF
+pass;
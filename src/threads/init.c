@@ -41,6 +41,7 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #include "filesys/cache.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -254,10 +255,27 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-extents"))
+        inode_set_format (INODE_EXTENTS);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_capacity = atoi (value);
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (value != NULL && !strcmp (value, "clock"))
+            cache_policy = CACHE_CLOCK;
+          else if (value != NULL && !strcmp (value, "lfu"))
+            cache_policy = CACHE_LFU;
+          else
+            PANIC ("unknown cache policy `%s' (use clock or lfu)", value);
+        }
+      else if (!strcmp (name, "-cache-flush"))
+        cache_flush_ms = atoi (value);
+      else if (!strcmp (name, "-cache-dirty"))
+        cache_dirty_pct = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -326,6 +344,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"cache-bench", 1, fsutil_cache_bench},
+      {"alloc-bench", 1, fsutil_alloc_bench},
 #endif
       {NULL, 0, NULL},
     };
@@ -375,6 +395,8 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  cache-bench        Time buffer cache hits at several cache sizes.\n"
+          "  alloc-bench        Time creating and growing files.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -382,8 +404,13 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -extents           With -f, map file data with extents.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=COUNT       Cache COUNT disk sectors (default: scale with RAM).\n"
+          "  -cache-policy=POL  Evict cache blocks by POL: clock (default) or lfu.\n"
+          "  -cache-flush=MS    Write dirty cache blocks back every MS ms (0: never).\n"
+          "  -cache-dirty=PCT   Write back early once PCT%% of cache blocks are dirty.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
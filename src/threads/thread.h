@@ -105,6 +105,7 @@ struct thread
 
     /* Information needed for filesys */
     struct dir* cwd;                    /* Current Working directory */
+    int journal_depth;                  /* Nested journal operations. */
 
 
 #ifdef USERPROG
@@ -7,6 +7,7 @@
 #include <bitmap.h>
 #include <round.h>
 #include "threads/interrupt.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/shutdown.h"
@@ -18,11 +19,13 @@
 
 static void syscall_handler (struct intr_frame *);
 static struct bitmap *mmap_index;
+static struct lock mmap_index_lock;     /* Guards MMAP_INDEX. */
 
 void
 syscall_init (void) 
 {
   mmap_index = bitmap_create (128);
+  lock_init (&mmap_index_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -142,6 +145,25 @@ syscall_handler (struct intr_frame *f)
     f->eax = inumber ((int)*arg0);
     break;  
 
+  case SYS_CACHESTAT:
+    check_valid_addr (arg0);
+    f->eax = cachestat ((struct cache_stats *)*arg0);
+    break;
+
+  case SYS_GETDENTS:
+    check_valid_addr (arg2);
+    f->eax = getdents ((int)*arg0, (struct dirent *)*arg1, (unsigned)*arg2);
+    break;
+
+  case SYS_FSYNC:
+    check_valid_addr (arg0);
+    f->eax = fsync ((int)*arg0);
+    break;
+
+  case SYS_SYNC:
+    sync ();
+    break;
+
   default:
     break;
   }
@@ -170,9 +192,7 @@ pid_t exec (const char *cmd_line) {
   check_valid_addr (p);
   while (*p != '\0')
     check_valid_addr (++p);
-  lock_acquire (&filesys_lock);
   pid_t pid = process_execute (cmd_line);
-  lock_release (&filesys_lock);
   return pid;
 }
 
@@ -183,9 +203,7 @@ int wait (pid_t pid) {
 
 bool create (const char *file, unsigned initial_size) {
   check_valid_addr (file);
-  lock_acquire (&filesys_lock);
   if (strlen (file) > 14) {
-    lock_release (&filesys_lock);
     return false;
   }
   char file_name[15];
@@ -193,25 +211,21 @@ bool create (const char *file, unsigned initial_size) {
   parse_path (file, file_name, &dir_ptr);
   struct inode *inode = dir_get_inode (dir_ptr);
   if (inode_get_removed (inode)) {
-    lock_release (&filesys_lock);
     return false;
   }
   bool success = filesys_create_dir (file_name, dir_ptr, initial_size, false);
   dir_close (dir_ptr);
-  lock_release (&filesys_lock);
   return success;
 }
 
 bool remove (const char *file) {
   check_valid_addr (file);
-  lock_acquire (&filesys_lock);
   char file_name[15];
   struct dir *dir_ptr = NULL;
   parse_path (file, file_name, &dir_ptr);
   if (strcmp (file_name, ".") == 0 || strcmp (file_name, "..") == 0)
     return false;
   bool success = filesys_remove_dir (file_name, dir_ptr);
-  lock_release (&filesys_lock);
   return success;
 }
 
@@ -222,14 +236,12 @@ int open (const char *file) {
   struct file *fp;
   if (strlen (file) == 0)
     return -1;
-  lock_acquire (&filesys_lock);
   parse_path (file, file_name, &dir_ptr);
 
   if (strcmp (file_name, ".") == 0 || strlen (file_name) == 0) {
     fp = (struct file *)dir_ptr;
     struct inode *inode = dir_get_inode (dir_ptr);
     if (inode_get_removed (inode)) {
-      lock_release (&filesys_lock);
       return -1;
     }
   }
@@ -237,7 +249,6 @@ int open (const char *file) {
     fp = (struct file *)dir_get_parent (dir_ptr);
     struct inode *inode = dir_get_inode (dir_ptr);
     if (inode_get_removed (inode)) {
-      lock_release (&filesys_lock);
       return -1;
     }
   }
@@ -251,19 +262,15 @@ int open (const char *file) {
         if (strcmp (thread_name (), file) == 0)
           file_deny_write (fp);
         cur->fd[i] = fp;
-        lock_release (&filesys_lock);
         return i;
       }
     }
   }
-  lock_release (&filesys_lock);
   return -1;
 }
 
 int filesize (int fd) {
-  lock_acquire (&filesys_lock);
   int length = file_length (thread_current ()->fd[fd]);
-  lock_release (&filesys_lock);
   return length;
 }
 
@@ -271,7 +278,6 @@ int read (int fd, void *buffer, unsigned size) {
   check_valid_addr (buffer);
   struct thread *cur = thread_current ();
   int result = -1;
-  lock_acquire (&filesys_lock);
 
   if (fd == 0) {
     input_getc ();
@@ -284,7 +290,6 @@ int read (int fd, void *buffer, unsigned size) {
       buffer_set_pin (buffer, size, false);
     }
   }
-  lock_release (&filesys_lock);
   return result;
 }
 
@@ -293,7 +298,6 @@ int write (int fd, const void *buffer, unsigned size) {
   struct thread *cur = thread_current ();
   int result = -1;
 
-  lock_acquire (&filesys_lock);
   if (fd == 1 && size <= 512) {
     putbuf(buffer, size);
     result = size;
@@ -307,30 +311,24 @@ int write (int fd, const void *buffer, unsigned size) {
         buffer_set_pin ((void *)buffer, size, false);
       }
   }
-  lock_release (&filesys_lock);
   return result;
 }
 
 void seek (int fd, unsigned position) {
-  lock_acquire (&filesys_lock);
   struct thread *cur = thread_current ();
   if (fd > 1 && fd < 128) {
     struct file *fp = cur->fd[fd];
     if (fp)
       file_seek (fp, position);
   }
-  lock_release (&filesys_lock);
 }
 
 unsigned tell (int fd) {
-  lock_acquire (&filesys_lock);
   off_t pos = file_tell (thread_current ()->fd[fd]);
-  lock_release (&filesys_lock);
   return pos;
 }
 
 void close (int fd) {
-  lock_acquire (&filesys_lock);
   struct thread *cur = thread_current ();
   if (fd > 1 && fd < 128) {
     struct file *fp = cur->fd[fd];
@@ -338,7 +336,6 @@ void close (int fd) {
     if (fp)
       file_close (fp);
   }
-  lock_release (&filesys_lock);
 }
 
 mapid_t mmap (int fd, void *addr) {
@@ -349,7 +346,6 @@ mapid_t mmap (int fd, void *addr) {
     return -1;
   }
 
-  lock_acquire (&filesys_lock);
 
   struct thread *cur = thread_current ();
   struct file *fp = file_reopen (cur->fd[fd]);
@@ -359,7 +355,6 @@ mapid_t mmap (int fd, void *addr) {
   for (unsigned i = 0; i < (ROUND_UP (size, PGSIZE) / PGSIZE); i++) {
     struct spte *overlap = spt_find (spt, addr);
     if (overlap != NULL){
-      lock_release (&filesys_lock);
       return -1;
     }
   }
@@ -370,7 +365,9 @@ mapid_t mmap (int fd, void *addr) {
   mape->fp = fp;
   mape->addr = addr;
   mape->size = size;
+  lock_acquire (&mmap_index_lock);
   mapid_t mapid = (mapid_t) bitmap_scan_and_flip (mmap_index, 0, 1, false);
+  lock_release (&mmap_index_lock);
   mape->mapid = mapid;
   list_push_back (map_list, &mape->list_elem);
   off_t ofs = 0;
@@ -407,12 +404,10 @@ mapid_t mmap (int fd, void *addr) {
       addr += PGSIZE;
       ofs += PGSIZE;
     }
-  lock_release (&filesys_lock);
   return mapid;
 }
 
 void munmap (mapid_t mapping) {
-  lock_acquire (&filesys_lock);
   
   struct thread *cur = thread_current ();
   struct hash *spt = &cur->spt;
@@ -422,7 +417,9 @@ void munmap (mapid_t mapping) {
   for (e = list_begin (map_list); e != list_end (map_list); e = list_next (e)) {
     mape = list_entry (e, struct mape, list_elem);
     if (mape->mapid == mapping) {
+      lock_acquire (&mmap_index_lock);
       size_t index = bitmap_scan_and_flip (mmap_index, mapping, 1, true);
+      lock_release (&mmap_index_lock);
       if (index == BITMAP_ERROR) {
         PANIC ("munmap BITMAP ERROR");
       }
@@ -454,13 +451,11 @@ void munmap (mapid_t mapping) {
       list_remove (&mape->list_elem);
       file_close (mape->fp);
       free (mape);
-      lock_release (&filesys_lock);
       return;
     }
   }
   PANIC ("Unreachable point reached\n");
   file_close (mape->fp);
-  lock_release (&filesys_lock);
 
 }
 
@@ -472,9 +467,7 @@ chdir (const char *dir)
   char file_name[15];
   struct dir *dir_ptr = NULL;
 
-  // lock_acquire (&filesys_lock);
   parse_path (dir, file_name, &dir_ptr);
-  // lock_release (&filesys_lock);
   if (strchr (file_name, 47) != NULL)
     return false;
   if (file_name != NULL && strchr(file_name, 47) != NULL) {
@@ -554,6 +547,74 @@ inumber (int fd)
   return inode_get_inumber (inode);
 }
 
+bool
+cachestat (struct cache_stats *stats)
+{
+  struct cache_stats s;
+  check_valid_addr (stats);
+  check_valid_addr ((uint8_t *) stats + sizeof *stats - 1);
+  cache_get_stats (&s);
+  memcpy (stats, &s, sizeof s);
+  return true;
+}
+
+/* Number of entries getdents() reads from the directory at a time. */
+#define GETDENTS_BATCH 16
+
+/* Fills ENTS with up to CNT of the next entries of directory FD.
+   Returns the number of entries filled, 0 at end of directory, or
+   -1 if FD is not an open directory. */
+int
+getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  struct thread *cur = thread_current ();
+  struct dirent batch[GETDENTS_BATCH];
+  struct file *fp;
+  unsigned done = 0;
+  uint8_t *p;
+
+  if (fd < 2 || fd >= 128 || (fp = cur->fd[fd]) == NULL
+      || !inode_dir (file_get_inode (fp)))
+    return -1;
+  if (cnt > (uintptr_t) PHYS_BASE / sizeof *ents)
+    exit (-1);
+  for (p = (uint8_t *) ents; p < (uint8_t *) (ents + cnt);
+       p = (uint8_t *) pg_round_down (p) + PGSIZE)
+    check_valid_addr (p);
+
+  while (done < cnt)
+    {
+      size_t want = cnt - done < GETDENTS_BATCH ? cnt - done : GETDENTS_BATCH;
+      size_t got = dir_getdents ((struct dir *) fp, batch, want);
+      memcpy (ents + done, batch, got * sizeof *batch);
+      done += got;
+      if (got < want)
+        break;
+    }
+  return done;
+}
+
+/* Writes the changes to open file or directory FD to disk.
+   Returns false if FD is not open. */
+bool
+fsync (int fd)
+{
+  struct thread *cur = thread_current ();
+  struct file *fp;
+
+  if (fd < 2 || fd >= 128 || (fp = cur->fd[fd]) == NULL)
+    return false;
+  inode_sync (file_get_inode (fp));
+  return true;
+}
+
+/* Writes all changes to disk. */
+void
+sync (void)
+{
+  filesys_sync ();
+}
+
 bool parse_path (const char *dir, char *file_name, struct dir **dir_ptr) {
 
   /* 
@@ -32,6 +32,10 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char *name);
 bool isdir (int fd);
 int inumber (int fd);
+bool cachestat (struct cache_stats *stats);
+int getdents (int fd, struct dirent *ents, unsigned cnt);
+bool fsync (int fd);
+void sync (void);
 bool parse_path (const char *dir, char *file_name, struct dir **dir_ptr);
 
 #endif /* userprog/syscall.h */